@@ -1,59 +1,465 @@
 #include <iostream>
 #include <iomanip>
 #include <functional>
+#include <iterator>
 #include <fstream>
 #include <chrono>
 #include <vector>
 #include <queue>
 #include <map>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <memory>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <type_traits>
+#include <utility>
+#if __has_include(<compare>)
+#include <compare>
+#endif
 
 #pragma once
 
-template <typename Key, typename Info>
+#include "frozen_avl_tree.h"
+#include "frozen_kary_tree.h"
+#include "mapped_file.h"
+#include "task_pool.h"
+#include "word_scan.h"
+
+// Node allocation policies. avl_tree obtains every node through Allocator<Node>,
+// so the policy only has to know how to create and destroy objects of one type.
+
+/**
+ * @brief Default policy: every node is a separate heap allocation
+ */
+template <typename T>
+class heap_allocator{
+public:
+    // Nodes have to be destroyed one by one
+    static constexpr bool bulk_release = false;
+    // Every node is independent, so a node can be handed over to another allocator
+    static constexpr bool transferable_nodes = true;
+
+    template <typename... Args> T* create(Args&&... args){
+        return new T(std::forward<Args>(args)...);
+    }
+
+    void destroy(T* ptr){
+        delete ptr;
+    }
+
+    void release_all() {}
+
+    void adopt(heap_allocator& other) {}
+};
+
+/**
+ * @brief Slab pool: nodes are carved out of fixed-size slabs and recycled through a free list.
+ * release_all() hands every slab back to the pool in O(1) without touching the nodes,
+ * the memory itself is returned to the system only when the pool is destroyed.
+ */
+template <typename T>
+class pool_allocator{
+private:
+    union Slot{
+        Slot* next;
+        alignas(T) unsigned char storage[sizeof(T)];
+    };
+
+    static constexpr std::size_t slab_slots = 1024;
+
+    std::vector<std::unique_ptr<Slot[]>> slabs;
+    std::size_t active_slabs = 0;   // slabs[0, active_slabs) are in use
+    Slot* next = nullptr;           // bump pointer inside the last active slab
+    Slot* end = nullptr;
+    Slot* free_list = nullptr;
+
+    void grow(){
+        if (active_slabs == slabs.size()){
+            slabs.emplace_back(new Slot[slab_slots]);
+        }
+        next = slabs[active_slabs++].get();
+        end = next + slab_slots;
+    }
+
+public:
+    // Destructors of trivially destructible nodes can be skipped altogether
+    static constexpr bool bulk_release = true;
+    // Nodes live in the pool's slabs and cannot be handed over one by one, only the whole pool can be adopted
+    static constexpr bool transferable_nodes = false;
+
+    pool_allocator() {}
+
+    pool_allocator(const pool_allocator&) = delete;
+    pool_allocator& operator=(const pool_allocator&) = delete;
+
+    // Moving hands all slabs over, objects allocated from other stay where they are and belong to this pool
+    pool_allocator(pool_allocator&& other) noexcept
+        : slabs(std::move(other.slabs)), active_slabs(other.active_slabs), next(other.next), end(other.end), free_list(other.free_list) {
+        other.slabs.clear();
+        other.release_all();
+    }
+
+    pool_allocator& operator=(pool_allocator&& other) noexcept{
+        if (&other != this){
+            slabs = std::move(other.slabs);
+            active_slabs = other.active_slabs;
+            next = other.next;
+            end = other.end;
+            free_list = other.free_list;
+
+            other.slabs.clear();
+            other.release_all();
+        }
+        return *this;
+    }
+
+    template <typename... Args> T* create(Args&&... args){
+        Slot* slot;
+        if (free_list != nullptr){
+            slot = free_list;
+            free_list = free_list->next;
+        } else {
+            if (next == end) grow();
+            slot = next++;
+        }
+
+        try {
+            return new (slot->storage) T(std::forward<Args>(args)...);
+        } catch (...) {
+            slot->next = free_list;
+            free_list = slot;
+            throw;
+        }
+    }
+
+    void destroy(T* ptr){
+        ptr->~T();
+        Slot* slot = reinterpret_cast<Slot*>(ptr);
+        slot->next = free_list;
+        free_list = slot;
+    }
+
+    /**
+     * @brief marks all slabs as free, objects that are still alive are not destroyed
+     *
+     */
+    void release_all(){
+        active_slabs = 0;
+        next = end = nullptr;
+        free_list = nullptr;
+    }
+
+    /**
+     * @brief takes over all slabs of other pool, objects allocated by it are now owned by this pool
+     *
+     */
+    void adopt(pool_allocator& other){
+        if (&other == this) return;
+
+        // Unused tail of other's current slab and its free list join this free list
+        for (Slot* slot = other.next; slot != other.end; ++slot){
+            slot->next = free_list;
+            free_list = slot;
+        }
+        while (other.free_list != nullptr){
+            Slot* slot = other.free_list;
+            other.free_list = slot->next;
+            slot->next = free_list;
+            free_list = slot;
+        }
+
+        // Slabs in use go in front of this pool's active slabs, spare ones to the back
+        slabs.insert(slabs.begin(), std::make_move_iterator(other.slabs.begin()),
+                     std::make_move_iterator(other.slabs.begin() + other.active_slabs));
+        slabs.insert(slabs.end(), std::make_move_iterator(other.slabs.begin() + other.active_slabs),
+                     std::make_move_iterator(other.slabs.end()));
+        active_slabs += other.active_slabs;
+
+        other.slabs.clear();
+        other.release_all();
+    }
+};
+
+/**
+ * @brief Slab pool that also owns the key bytes, for trees with std::string_view keys.
+ * The tree copies every new key into an append-only arena with store_key(), nodes keep a view of it.
+ * Bytes of removed keys are reused only after release_all(), so clear() stays O(1).
+ */
+template <typename T>
+class arena_allocator : public pool_allocator<T>{
+private:
+    struct Chunk{
+        std::unique_ptr<char[]> bytes;
+        std::size_t size;
+    };
+
+    static constexpr std::size_t chunk_bytes = 64 * 1024;
+
+    std::vector<Chunk> chunks;
+    std::size_t active_chunks = 0;  // chunks[0, active_chunks) are in use
+    char* next = nullptr;           // free bytes of the last active chunk
+    char* end = nullptr;
+
+    void grow(std::size_t length){
+        if (active_chunks == chunks.size() || chunks[active_chunks].size < length){
+            std::size_t size = std::max(chunk_bytes, length);
+            chunks.insert(chunks.begin() + active_chunks, Chunk{std::unique_ptr<char[]>(new char[size]), size});
+        }
+        next = chunks[active_chunks].bytes.get();
+        end = next + chunks[active_chunks].size;
+        active_chunks++;
+    }
+
+public:
+    arena_allocator() {}
+
+    arena_allocator(arena_allocator&& other) noexcept
+        : pool_allocator<T>(std::move(other)), chunks(std::move(other.chunks)), active_chunks(other.active_chunks), next(other.next), end(other.end) {
+        other.chunks.clear();
+        other.release_all();
+    }
+
+    arena_allocator& operator=(arena_allocator&& other) noexcept{
+        if (&other != this){
+            pool_allocator<T>::operator=(std::move(other));
+            chunks = std::move(other.chunks);
+            active_chunks = other.active_chunks;
+            next = other.next;
+            end = other.end;
+
+            other.chunks.clear();
+            other.release_all();
+        }
+        return *this;
+    }
+
+    /**
+     * @brief copies key bytes into the arena
+     *
+     * @param key is anything std::string_view can be made from
+     * @return std::string_view of the copy, valid until release_all() or destruction of the arena
+     */
+    template <typename K>
+    std::string_view store_key(const K& key){
+        std::string_view text(key);
+        if (static_cast<std::size_t>(end - next) < text.size()) grow(text.size());
+        if (text.empty()) return std::string_view();
+
+        char *copy = next;
+        std::memcpy(copy, text.data(), text.size());
+        next += text.size();
+        return std::string_view(copy, text.size());
+    }
+
+    void release_all(){
+        pool_allocator<T>::release_all();
+        active_chunks = 0;
+        next = end = nullptr;
+    }
+
+    // Takes over slabs and key bytes of other
+    void adopt(arena_allocator& other){
+        if (&other == this) return;
+        pool_allocator<T>::adopt(other);
+
+        chunks.insert(chunks.begin(), std::make_move_iterator(other.chunks.begin()),
+                      std::make_move_iterator(other.chunks.begin() + other.active_chunks));
+        chunks.insert(chunks.end(), std::make_move_iterator(other.chunks.begin() + other.active_chunks),
+                      std::make_move_iterator(other.chunks.end()));
+        active_chunks += other.active_chunks;
+
+        other.chunks.clear();
+        other.release_all();
+    }
+};
+
+namespace avl_detail{
+    // Key and info of an input element, either a std::pair or an avl_tree element
+    template <typename E> auto element_key(const E& element) -> decltype((element.first)) { return element.first; }
+    template <typename E> auto element_key(const E& element) -> decltype((element.key)) { return element.key; }
+    template <typename E> auto element_info(const E& element) -> decltype((element.second)) { return element.second; }
+    template <typename E> auto element_info(const E& element) -> decltype((element.info)) { return element.info; }
+
+    // Allocators with store_key() keep key bytes themselves, the tree stores what store_key() returns
+    template <typename Allocator, typename = void>
+    struct stores_keys : std::false_type {};
+
+    template <typename Allocator>
+    struct stores_keys<Allocator, std::void_t<decltype(&Allocator::template store_key<std::string_view>)>> : std::true_type {};
+
+    template <typename A, typename B, typename = void>
+    struct has_compare_member : std::false_type {};
+
+    template <typename A, typename B>
+    struct has_compare_member<A, B, std::void_t<decltype(std::declval<const A&>().compare(std::declval<const B&>()))>> : std::true_type {};
+
+#if defined(__cpp_impl_three_way_comparison) && defined(__cpp_lib_three_way_comparison)
+    template <typename A, typename B, typename = void>
+    struct has_three_way : std::false_type {};
+
+    template <typename A, typename B>
+    struct has_three_way<A, B, std::void_t<decltype(std::declval<const A&>() <=> std::declval<const B&>())>> : std::true_type {};
+#endif
+
+    // Balancing data of a node, ranked trees also keep the number of nodes in the subtree.
+    // Both fields share the 8 bytes in front of the node's pointers.
+    template <bool Ranked>
+    class node_stats{
+    protected:
+        int height = 1;
+    };
+
+    template <>
+    class node_stats<true>{
+    protected:
+        int height = 1;
+        int count = 1;
+    };
+
+    // First 8 bytes of a key read as a big-endian number, shorter keys are padded with zero bytes.
+    // Comparing prefixes orders keys like comparing the bytes, only equal prefixes leave the order open.
+    inline std::uint64_t key_prefix(std::string_view key){
+        std::size_t n = std::min<std::size_t>(key.size(), 8);
+        std::uint64_t prefix = 0;
+        for (std::size_t i = 0; i < n; ++i){
+            prefix = (prefix << 8) | static_cast<unsigned char>(key[i]);
+        }
+        return (n == 0) ? 0 : prefix << (8 * (8 - n));
+    }
+
+    // Key prefix cached in nodes of trees ordered by prefix_less, placed in front of node_stats
+    template <bool Cached>
+    class node_prefix{};
+
+    template <>
+    class node_prefix<true>{
+    protected:
+        std::uint64_t prefix = 0;
+    };
+}
+
+/**
+ * @brief Transparent less for string keys (std::string, std::string_view, const char*), same order as std::less<>.
+ * avl_tree ordered by it keeps the first 8 bytes of every key in the node, most comparisons during a descent
+ * are then decided by one integer compare and the key itself is read only when the prefixes are equal.
+ */
+struct prefix_less{
+    using is_transparent = void;
+
+    template <typename A, typename B>
+    bool operator()(const A& a, const B& b) const{
+        return std::string_view(a) < std::string_view(b);
+    }
+};
+
+template <typename Key, typename Info, typename Compare = std::less<>, template <typename> class Allocator = heap_allocator, bool Ranked = false>
 class avl_tree{
 private:
-    class Node{
+    // Nodes keep the key prefix when the tree is ordered by prefix_less
+    static constexpr bool cached_prefix = std::is_same<Compare, prefix_less>::value;
+
+    class Node : public avl_detail::node_prefix<cached_prefix>, public avl_detail::node_stats<Ranked>{
     private:
         Node* left;
         Node* right;
-        int height;
+        Node* parent;
 
     public:
-        Key key;
+        const Key key;
         Info info;
 
-        Node(const Key& key, const Info& info, Node* left = nullptr, Node* right = nullptr, int height = 1): key(key), info(info), left(left), right(right), height(height) {}
+        Node(const Key& key, const Info& info, Node* left = nullptr, Node* right = nullptr, int height = 1): key(key), info(info), left(left), right(right), parent(nullptr) {
+            this->height = height;
+        }
+
+        // Builds key from any type Key can be constructed from and info in place from the given arguments
+        template <typename K, typename... Args>
+        Node(std::piecewise_construct_t, K&& key, Args&&... args): key(std::forward<K>(key)), info(std::forward<Args>(args)...), left(nullptr), right(nullptr), parent(nullptr) {}
 
         friend class avl_tree;
     };
 
+    // AVL tree with n nodes is at most ~1.44 * log2(n) high, for n < 2^31 it is below 45
+    static constexpr int max_height = 48;
+
     Node *root = nullptr;
+    Node *leftmost = nullptr, *rightmost = nullptr;     // nodes of the smallest and the largest key, as in std::map
     int size = 0;
+    Compare comp;
+    Allocator<Node> alloc;
+
+    // True when Compare orders keys by their own operator<, so their compare() or <=> gives the same order
+    static constexpr bool natural_order = std::is_same<Compare, std::less<>>::value || std::is_same<Compare, std::less<Key>>::value || cached_prefix;
+
+    // Three-way comparison of keys: negative if a goes before b, 0 if they are equivalent, positive otherwise.
+    // Every level of a descent costs a single comparison for keys with compare() (std::string) or <=>.
+    template <typename A, typename B>
+    int compare(const A& a, const B& b) const{
+        if constexpr (natural_order && avl_detail::has_compare_member<A, B>::value){
+            int result = a.compare(b);
+            return (result > 0) - (result < 0);
+        }
+        else if constexpr (natural_order && avl_detail::has_compare_member<B, A>::value){
+            int result = b.compare(a);
+            return (result < 0) - (result > 0);
+        }
+#if defined(__cpp_impl_three_way_comparison) && defined(__cpp_lib_three_way_comparison)
+        else if constexpr (natural_order && avl_detail::has_three_way<A, B>::value){
+            auto result = a <=> b;
+            return (result > 0) - (result < 0);
+        }
+#endif
+        else{
+            if (comp(a, b)) return -1;
+            return comp(b, a) ? 1 : 0;
+        }
+    }
 
-    template <typename Fn> void for_each(Node* node, Fn fn){
-        if (node == nullptr) return;
-        for_each(node->left, fn);
-        fn(node->key, node->info);
-        for_each(node->right, fn);
+    // Prefix of a searched key, computed once per descent. Always 0 without cached prefixes.
+    template <typename K>
+    static std::uint64_t prefix_of(const K& key){
+        if constexpr (cached_prefix) return avl_detail::key_prefix(std::string_view(key));
+        else return 0;
     }
 
-    bool is_balanced_helper(typename avl_tree<Key, Info>::Node* node){
+    // Three-way comparison of key with a node's key, decided by the cached prefixes when they differ
+    template <typename K>
+    int compare_node(const K& key, std::uint64_t key_prefix, const Node* node) const{
+        if constexpr (cached_prefix){
+            if (key_prefix != node->prefix) return (key_prefix < node->prefix) ? -1 : 1;
+        }
+        return compare(key, node->key);
+    }
+
+    bool is_balanced_helper(Node* node){
         if (node == nullptr) return true;
 
-        int b_factor = avl_tree<Key, Info>::balance_factor(node);
+        int b_factor = balance_factor(node);
 
         if (b_factor < -1 || b_factor > 1) return false;  // Check if the balance factor is within the range [-1, 0, 1] || returns false if the tree is not balanced in this node
 
         return is_balanced_helper(node->left) && is_balanced_helper(node->right);
     }
 
+    // Destroys the subtree without recursion: left children are rotated up until
+    // the current node has none, then the node is freed and its right subtree follows
     void clear_helper(Node* node){
-        if (node != nullptr)
-        {
-            clear_helper(node->left);
-            clear_helper(node->right);
-            delete node;
-            size--;
+        while (node != nullptr){
+            if (node->left != nullptr){
+                Node *left = node->left;
+                node->left = left->right;
+                left->right = node;
+                node = left;
+            } else {
+                Node *right = node->right;
+                alloc.destroy(node);
+                size--;
+                node = right;
+            }
         }
     }
 
@@ -66,45 +472,281 @@ private:
         return left_height - right_height;
     }
 
+    static int count(const Node* node){
+        if constexpr (Ranked) return (node != nullptr) ? node->count : 0;
+        else return 0;
+    }
+
+    void update_count(Node* node){
+        if constexpr (Ranked) node->count = 1 + count(node->left) + count(node->right);
+    }
+
+    // Recomputes height and, in ranked trees, subtree size from the children
     void update_height(Node* node){
         if (node != nullptr){
             int left_height = (node->left != nullptr) ? node->left->height : 0;
             int right_height = (node->right != nullptr) ? node->right->height : 0;
             
             node->height = 1 + std::max(left_height, right_height);
+            update_count(node);
         }
     }
 
     Node* copy_helper(const Node* src){
-        if (src == nullptr) return nullptr;
+        Node *result = nullptr;
+
+        // Right subtrees that still have to be copied, at most one per level
+        const Node *pending_src[max_height];
+        Node *pending_parent[max_height];
+        int pending = 0;
+
+        Node *parent = nullptr;
+        Node **link = &result;
+        while (true){
+            while (src != nullptr){
+                Node *new_node = create_node(src->key, src->info);
+                size++;
+                new_node->height = src->height;
+                if constexpr (Ranked) new_node->count = src->count;
+                new_node->parent = parent;
+                *link = new_node;
+
+                if (src->right != nullptr){
+                    pending_src[pending] = src->right;
+                    pending_parent[pending] = new_node;
+                    pending++;
+                }
 
-        Node *new_node = new Node(src->key, src->info);
-        new_node->left = copy_helper(src->left);
-        new_node->right = copy_helper(src->right);
-        new_node->height = src->height;
+                parent = new_node;
+                link = &new_node->left;
+                src = src->left;
+            }
 
-        return new_node;
+            if (pending == 0) break;
+
+            pending--;
+            src = pending_src[pending];
+            parent = pending_parent[pending];
+            link = &parent->right;
+        }
+
+        return result;
     }
 
-    void insert_helper(Node*& node, const Key& key, const Info& info, Node*& found_node)
+    // Retraces the path after an insertion or a removal below path[depth - 1].
+    // Stops rebalancing as soon as a subtree keeps its previous height, its ancestors are not affected then
+    // apart from subtree sizes of a ranked tree.
+    void rebalance_path(Node **path[], int depth){
+        while (depth-- > 0){
+            Node *&node = *path[depth];
+            int old_height = node->height;
+
+            node = balance(node);
+
+            if (node->height == old_height) break;
+        }
+
+        if constexpr (Ranked){
+            while (depth-- > 0) update_count(*path[depth]);
+        }
+    }
+
+    // Every node is made here. Key is built from key, or from its copy in the allocator when the allocator stores keys.
+    template <typename K, typename... Args>
+    Node* create_node(K&& key, Args&&... args){
+        Node *node;
+        if constexpr (avl_detail::stores_keys<Allocator<Node>>::value){
+            node = alloc.create(std::piecewise_construct, alloc.store_key(key), std::forward<Args>(args)...);
+        }
+        else node = alloc.create(std::piecewise_construct, std::forward<K>(key), std::forward<Args>(args)...);
+
+        if constexpr (cached_prefix) node->prefix = prefix_of(node->key);
+        return node;
+    }
+
+    // Returns the node with the key, a new node with info built from args is created if key is not in the tree.
+    // Existing node keeps its info, key and args are moved from only when a node is created.
+    template <typename K, typename... Args>
+    Node* insert_helper(K&& key, bool& inserted, Args&&... args)
     {
-        if(node == nullptr){
-            size++;
-            node = new Node(key, info);
-            found_node = node;
+        Node **path[max_height + 1];
+        int depth = 0;
+
+        std::uint64_t key_prefix = prefix_of(key);
+        Node **link = &root;
+        while (*link != nullptr){
+            Node *node = *link;
+            path[depth++] = link;
+
+            int order = compare_node(key, key_prefix, node);
+            if (order < 0) link = &node->left;
+            else if (order > 0) link = &node->right;
+            else {
+                inserted = false;
+                return node;
+            }
+        }
+
+        Node *new_node = create_node(std::forward<K>(key), std::forward<Args>(args)...);
+        new_node->parent = (depth > 0) ? *path[depth - 1] : nullptr;
+        *link = new_node;
+        link_end(new_node);
+        size++;
+        inserted = true;
+
+        rebalance_path(path, depth);
+        return new_node;
+    }
+
+    // Keeps leftmost and rightmost current after node was linked in as a leaf, before any rotation
+    void link_end(Node* node){
+        Node *parent = node->parent;
+        if (parent == nullptr) leftmost = rightmost = node;
+        else if (parent == leftmost && parent->left == node) leftmost = node;
+        else if (parent == rightmost && parent->right == node) rightmost = node;
+    }
+
+    // Finds leftmost and rightmost again after the tree was rebuilt by a bulk operation, O(log n)
+    void update_ends(){
+        leftmost = (root != nullptr) ? find_min(root) : nullptr;
+        rightmost = (root != nullptr) ? find_max(root) : nullptr;
+    }
+
+    // Link that points to node, in its parent or root
+    Node** link_to(Node* node){
+        Node *parent = node->parent;
+        if (parent == nullptr) return &root;
+        return (parent->left == node) ? &parent->left : &parent->right;
+    }
+
+    // Lowest node on the way from finger to the root whose subtree holds the place of key, or the node with key.
+    // Crossing a link towards key bounds the subtree only if the parent is beyond key,
+    // a parent on the finger side just means the place of key is in its other subtree or further up.
+    template <typename K>
+    Node* climb_from(Node* finger, const K& key, std::uint64_t key_prefix) const{
+        int order = compare_node(key, key_prefix, finger);
+        if (order == 0) return finger;
+
+        bool greater = order > 0;
+        Node *node = finger, *start = finger;
+        while (node->parent != nullptr){
+            Node *parent = node->parent;
+            if ((parent->left == node) == greater){
+                order = compare_node(key, key_prefix, parent);
+                if (order == 0) return parent;
+                if ((order < 0) == greater) return node;
+
+                start = parent;
+            }
+            node = parent;
         }
 
-        if(key < node->key) {
-            insert_helper(node->left, key, info, found_node);
-        } else if(key > node->key){
-            insert_helper(node->right, key, info, found_node);
-        } else{
-            // if duplicate is found, update the info
-            node->info = info;
+        return start;
+    }
+
+    // Rebalances from node to the root through parent links, stops early like rebalance_path()
+    void rebalance_up(Node* node){
+        while (node != nullptr){
+            Node *parent = node->parent;
+            Node **link = link_to(node);
+            int old_height = node->height;
+
+            *link = balance(node);
+
+            if ((*link)->height == old_height) break;
+            node = parent;
         }
 
-        update_height(node);
-        node = balance(node);
+        if constexpr (Ranked){
+            for (node = (node != nullptr) ? node->parent : nullptr; node != nullptr; node = node->parent) update_count(node);
+        }
+    }
+
+    // insert_helper() that starts searching at finger instead of root. Costs O(log d) for a key d positions
+    // away from finger, insertion next to finger is amortized O(1) in unranked trees.
+    template <typename K, typename... Args>
+    Node* insert_near(Node* finger, K&& key, bool& inserted, Args&&... args){
+        if (finger == nullptr) return insert_helper(std::forward<K>(key), inserted, std::forward<Args>(args)...);
+
+        std::uint64_t key_prefix = prefix_of(key);
+        Node *node = climb_from(finger, key, key_prefix), *parent = node->parent;
+        Node **link = link_to(node);
+        while (*link != nullptr){
+            node = *link;
+            int order = compare_node(key, key_prefix, node);
+            if (order == 0){
+                inserted = false;
+                return node;
+            }
+
+            parent = node;
+            link = (order < 0) ? &node->left : &node->right;
+        }
+
+        Node *new_node = create_node(std::forward<K>(key), std::forward<Args>(args)...);
+        new_node->parent = parent;
+        *link = new_node;
+        link_end(new_node);
+        size++;
+        inserted = true;
+
+        rebalance_up(parent);
+        return new_node;
+    }
+
+    // Creates a node between the in-order neighbours prev and next without comparing keys, either may be nullptr
+    // at the ends of the tree. Of two neighbours one always has a free child link on the side of the other.
+    template <typename K, typename... Args>
+    Node* insert_between(Node* prev, Node* next, K&& key, Args&&... args){
+        Node *parent = nullptr, **link = &root;
+        if (prev != nullptr && prev->right == nullptr){
+            parent = prev;
+            link = &prev->right;
+        }
+        else if (next != nullptr){
+            parent = next;
+            link = &next->left;
+        }
+
+        Node *new_node = create_node(std::forward<K>(key), std::forward<Args>(args)...);
+        new_node->parent = parent;
+        *link = new_node;
+        link_end(new_node);
+        size++;
+
+        rebalance_up(parent);
+        return new_node;
+    }
+
+    // insert_helper() that first tries the place next to hint, on either side of it. hint == nullptr stands for end(),
+    // its neighbour is rightmost. A key that lands between hint and its neighbour is linked in without a search,
+    // otherwise the search climbs from the neighbour. Neighbours past the ends come from the cached ends,
+    // so appending before leftmost or after rightmost takes one comparison and no walk through the tree.
+    template <typename K, typename... Args>
+    Node* insert_hinted(Node* hint, K&& key, bool& inserted, Args&&... args){
+        std::uint64_t key_prefix = prefix_of(key);
+        int order = (hint != nullptr) ? compare_node(key, key_prefix, hint) : -1;
+        if (order == 0){
+            inserted = false;
+            return hint;
+        }
+
+        Node *prev = hint, *next = hint;
+        if (order < 0) prev = (hint == nullptr) ? rightmost : ((hint == leftmost) ? nullptr : prev_node(hint));
+        else next = (hint == rightmost) ? nullptr : next_node(hint);
+
+        Node *neighbour = (order < 0) ? prev : next;
+        int neighbour_order = (neighbour != nullptr) ? compare_node(key, key_prefix, neighbour) : -order;
+        if (neighbour_order == 0){
+            inserted = false;
+            return neighbour;
+        }
+        if ((neighbour_order > 0) == (order < 0)){
+            inserted = true;
+            return insert_between(prev, next, std::forward<K>(key), std::forward<Args>(args)...);
+        }
+
+        return insert_near(neighbour, std::forward<K>(key), inserted, std::forward<Args>(args)...);
     }
 
     Node* balance(Node* node){
@@ -133,11 +775,15 @@ private:
         return node;
     }
 
+    // Rotations keep parent links, the new subtree root takes over the parent of the rotated node
     Node* rotate_right(Node* rotate)
     {
         Node *new_root = rotate->left;
         rotate->left = new_root->right;
+        if (rotate->left != nullptr) rotate->left->parent = rotate;
         new_root->right = rotate;
+        new_root->parent = rotate->parent;
+        rotate->parent = new_root;
 
         update_height(rotate);
         update_height(new_root);
@@ -148,7 +794,10 @@ private:
     Node* rotate_left(Node* rotate){
         Node *new_root = rotate->right;
         rotate->right = new_root->left;
+        if (rotate->right != nullptr) rotate->right->parent = rotate;
         new_root->left = rotate;
+        new_root->parent = rotate->parent;
+        rotate->parent = new_root;
 
         update_height(rotate);
         update_height(new_root);
@@ -156,60 +805,477 @@ private:
         return new_root;
     }
 
-    Node* find_min(Node* node) const{
-        if (!node->left) return node;
+    static Node* find_min(Node* node){
+        while (node->left != nullptr) node = node->left;
 
-        return find_min(node->left);
+        return node;
     }
 
-    Node* find_max(Node* node) const{
-        if(!node->left) return node;
+    static Node* find_max(Node* node){
+        while (node->right != nullptr) node = node->right;
 
-        return find_max(node->right);
+        return node;
     }
 
-    Node* find_node(Node* node, const Key& key) const{
-        if (node == nullptr || key == node->key) return node;
+    template <typename K>
+    Node* find_node(Node* node, const K& key) const{
+        std::uint64_t key_prefix = prefix_of(key);
+        while (node != nullptr){
+            int order = compare_node(key, key_prefix, node);
+            if (order == 0) break;
 
-        if (key < node->key) return find_node(node->left, key);
+            node = (order < 0) ? node->left : node->right;
+        }
 
-        else return find_node(node->right, key);
+        return node;
     }
 
-    bool remove_helper(Node *&node, const Key &key)
-    {
-        if (!node) return false;
-        
-        bool deleted = false;
-        
-        if (node->key > key) { deleted = remove_helper(node->left, key); }
+    // Looks up keys[0, count) in groups that walk down the tree in lock-step, one level per round.
+    // The child every lookup moves to is prefetched, so its cache miss overlaps with the steps of the other lookups.
+    template <typename K, typename Result>
+    void find_batch_helper(const K* keys, std::size_t count, Result* results) const{
+        constexpr std::size_t group = 16;
+        Node *nodes[group];
+        std::uint64_t prefixes[group];
+
+        for (std::size_t first = 0; first < count; first += group){
+            std::size_t n = std::min(group, count - first);
+            for (std::size_t i = 0; i < n; ++i){
+                nodes[i] = root;
+                prefixes[i] = prefix_of(keys[first + i]);
+                results[first + i] = nullptr;
+            }
 
-        else if (node->key < key) { deleted = remove_helper(node->right, key); }
+            for (bool walking = true; walking;){
+                walking = false;
+                for (std::size_t i = 0; i < n; ++i){
+                    Node *node = nodes[i];
+                    if (node == nullptr) continue;
+
+                    int order = compare_node(keys[first + i], prefixes[i], node);
+                    if (order == 0){
+                        results[first + i] = &node->info;
+                        nodes[i] = nullptr;
+                        continue;
+                    }
+
+                    node = (order < 0) ? node->left : node->right;
+                    if (node != nullptr){
+#if defined(__GNUC__)
+                        __builtin_prefetch(node);
+#endif
+                        walking = true;
+                    }
+                    nodes[i] = node;
+                }
+            }
+        }
+    }
 
+    template <typename K>
+    Node* find_from_node(Node* hint, const K& key) const{
+        if (hint == nullptr) return find_node(root, key);
+        return find_node(climb_from(hint, key, prefix_of(key)), key);
+    }
+
+    // First node with key not less than the given one
+    template <typename K>
+    Node* lower_bound_node(const K& key) const{
+        std::uint64_t key_prefix = prefix_of(key);
+        Node *node = root, *bound = nullptr;
+        while (node != nullptr){
+            if (compare_node(key, key_prefix, node) <= 0){
+                bound = node;
+                node = node->left;
+            }
+            else node = node->right;
+        }
+
+        return bound;
+    }
+
+    // First node with key greater than the given one
+    template <typename K>
+    Node* upper_bound_node(const K& key) const{
+        std::uint64_t key_prefix = prefix_of(key);
+        Node *node = root, *bound = nullptr;
+        while (node != nullptr){
+            if (compare_node(key, key_prefix, node) < 0){
+                bound = node;
+                node = node->left;
+            }
+            else node = node->right;
+        }
+
+        return bound;
+    }
+
+    // Builds perfectly balanced subtree from the next n elements of the sorted sequence
+    template <typename It>
+    Node* build_helper(It& it, int n, Node* parent){
+        if (n == 0) return nullptr;
+
+        int left_count = (n - 1) / 2;
+        Node *left = build_helper(it, left_count, nullptr);
+
+        Node *node = create_node(avl_detail::element_key(*it), avl_detail::element_info(*it));
+        ++it;
+        node->parent = parent;
+        node->left = left;
+        if (left != nullptr) left->parent = node;
+        node->right = build_helper(it, n - 1 - left_count, node);
+
+        update_height(node);
+        return node;
+    }
+
+    static int height(const Node* node){
+        return (node != nullptr) ? node->height : 0;
+    }
+
+    Node* attach(Node* left, Node* middle, Node* right){
+        middle->left = left;
+        middle->right = right;
+        if (left != nullptr) left->parent = middle;
+        if (right != nullptr) right->parent = middle;
+
+        update_height(middle);
+        return middle;
+    }
+
+    // Join of a subtree taller than right: middle and right hang off its right spine
+    // where the heights match, every level above is rebalanced once
+    Node* join_right(Node* tree, Node* middle, Node* right){
+        Node *spine = tree->right;
+        Node *joined = (height(spine) <= height(right) + 1) ? attach(spine, middle, right) : join_right(spine, middle, right);
+
+        tree->right = joined;
+        joined->parent = tree;
+        return balance(tree);
+    }
+
+    Node* join_left(Node* left, Node* middle, Node* tree){
+        Node *spine = tree->left;
+        Node *joined = (height(spine) <= height(left) + 1) ? attach(left, middle, spine) : join_left(left, middle, spine);
+
+        tree->left = joined;
+        joined->parent = tree;
+        return balance(tree);
+    }
+
+    // Joins subtrees left < middle < right of any heights in O(|height(left) - height(right)| + 1).
+    // Subtree roots passed to and returned by join and split functions have no parent.
+    Node* join_nodes(Node* left, Node* middle, Node* right){
+        Node *result;
+        if (height(left) > height(right) + 1) result = join_right(left, middle, right);
+        else if (height(right) > height(left) + 1) result = join_left(left, middle, right);
+        else result = attach(left, middle, right);
+
+        result->parent = nullptr;
+        return result;
+    }
+
+    // Detaches the node with the largest key, returns the rest of the subtree
+    Node* split_last(Node* tree, Node*& last){
+        if (tree->right == nullptr){
+            last = tree;
+            Node *rest = tree->left;
+            if (rest != nullptr) rest->parent = nullptr;
+            return rest;
+        }
+
+        Node *rest = split_last(tree->right, last);
+        if (tree->left != nullptr) tree->left->parent = nullptr;
+        return join_nodes(tree->left, tree, rest);
+    }
+
+    // Joins subtrees left < right without a middle node
+    Node* join_nodes(Node* left, Node* right){
+        if (left == nullptr) return right;
+        if (right == nullptr) return left;
+
+        Node *last;
+        left = split_last(left, last);
+        return join_nodes(left, last, right);
+    }
+
+    // Splits subtree into nodes with key less than key, the node with the key (or nullptr) and nodes with greater key
+    template <typename K>
+    void split_nodes(Node* tree, const K& key, Node*& less, Node*& found, Node*& greater){
+        if (tree == nullptr){
+            less = found = greater = nullptr;
+            return;
+        }
+
+        Node *left = tree->left, *right = tree->right;
+        if (left != nullptr) left->parent = nullptr;
+        if (right != nullptr) right->parent = nullptr;
+
+        int order = compare(key, tree->key);
+        if (order == 0){
+            less = left;
+            greater = right;
+            found = attach(nullptr, tree, nullptr);
+            found->parent = nullptr;
+        }
+        else if (order < 0){
+            Node *between;
+            split_nodes(left, key, less, found, between);
+            greater = join_nodes(between, tree, right);
+        }
         else{
-            if (!node->left || !node->right){
-                Node *temp = node->left ? node->left : node->right;
+            Node *between;
+            split_nodes(right, key, between, found, greater);
+            less = join_nodes(left, tree, between);
+        }
+    }
 
-                if (!temp){
-                    temp = node;
-                    node = nullptr;
-                }
-                else { *node = *temp; }
+    // Join-based set operations. tree is owned and rebuilt in place, src is only read, so
+    // the work is O(m log(n/m + 1)) for m = |src| plus allocation of the keys missing in tree.
+
+    // Adds keys of src to tree, combine(info, src_info) is called for keys present in both
+    template <typename Combine>
+    Node* union_nodes(Node* tree, const Node* src, Combine& combine){
+        if (src == nullptr) return tree;
+        if (tree == nullptr) return copy_helper(src);
+
+        Node *less, *found, *greater;
+        split_nodes(tree, src->key, less, found, greater);
+
+        if (found != nullptr) combine(found->info, src->info);
+        else{
+            found = create_node(src->key, src->info);
+            size++;
+        }
+
+        less = union_nodes(less, src->left, combine);
+        greater = union_nodes(greater, src->right, combine);
+        return join_nodes(less, found, greater);
+    }
+
+    // Removes keys of src from tree
+    Node* difference_nodes(Node* tree, const Node* src){
+        if (tree == nullptr || src == nullptr) return tree;
 
-                delete temp;
+        Node *less, *found, *greater;
+        split_nodes(tree, src->key, less, found, greater);
+
+        if (found != nullptr){
+            alloc.destroy(found);
+            size--;
+        }
+
+        less = difference_nodes(less, src->left);
+        greater = difference_nodes(greater, src->right);
+        return join_nodes(less, greater);
+    }
+
+    // Keeps only keys of tree that are present in src
+    Node* intersection_nodes(Node* tree, const Node* src){
+        if (tree == nullptr) return nullptr;
+        if (src == nullptr){
+            clear_helper(tree);
+            return nullptr;
+        }
+
+        Node *less, *found, *greater;
+        split_nodes(tree, src->key, less, found, greater);
+
+        less = intersection_nodes(less, src->left);
+        greater = intersection_nodes(greater, src->right);
+        return (found != nullptr) ? join_nodes(less, found, greater) : join_nodes(less, greater);
+    }
+
+    // Parallel versions of the set operations split work at the root key of src and hand one half to the pool.
+    // Every task works in a context tree of its own: nodes it allocates or frees and its size change
+    // are adopted by the forking task after the join, so allocators need no locking.
+
+    // Subtrees lower than this are too small to be worth another task
+    static constexpr int parallel_grain_height = 12;
+
+    void absorb(avl_tree& context){
+        alloc.adopt(context.alloc);
+        size += context.size;
+        context.size = 0;
+    }
+
+    Node* copy_parallel(const Node* src, task_pool& pool){
+        if (height(src) < parallel_grain_height) return copy_helper(src);
+
+        Node *node = create_node(src->key, src->info);
+        size++;
+
+        Node *left, *right;
+        avl_tree context;
+        context.comp = comp;
+        pool.fork_join([&] { left = copy_parallel(src->left, pool); },
+                       [&] { right = context.copy_parallel(src->right, pool); });
+        absorb(context);
+
+        return attach(left, node, right);
+    }
+
+    template <typename Combine>
+    Node* union_parallel(Node* tree, const Node* src, Combine& combine, task_pool& pool){
+        if (tree == nullptr) return copy_parallel(src, pool);
+        if (height(src) < parallel_grain_height) return union_nodes(tree, src, combine);
+
+        Node *less, *found, *greater;
+        split_nodes(tree, src->key, less, found, greater);
+
+        if (found != nullptr) combine(found->info, src->info);
+        else{
+            found = create_node(src->key, src->info);
+            size++;
+        }
+
+        avl_tree context;
+        context.comp = comp;
+        pool.fork_join([&] { less = union_parallel(less, src->left, combine, pool); },
+                       [&] { greater = context.union_parallel(greater, src->right, combine, pool); });
+        absorb(context);
+
+        return join_nodes(less, found, greater);
+    }
+
+    Node* difference_parallel(Node* tree, const Node* src, task_pool& pool){
+        if (height(src) < parallel_grain_height || height(tree) < parallel_grain_height) return difference_nodes(tree, src);
+
+        Node *less, *found, *greater;
+        split_nodes(tree, src->key, less, found, greater);
+
+        if (found != nullptr){
+            alloc.destroy(found);
+            size--;
+        }
+
+        avl_tree context;
+        context.comp = comp;
+        pool.fork_join([&] { less = difference_parallel(less, src->left, pool); },
+                       [&] { greater = context.difference_parallel(greater, src->right, pool); });
+        absorb(context);
+
+        return join_nodes(less, greater);
+    }
+
+    Node* intersection_parallel(Node* tree, const Node* src, task_pool& pool){
+        if (height(src) < parallel_grain_height || height(tree) < parallel_grain_height) return intersection_nodes(tree, src);
+
+        Node *less, *found, *greater;
+        split_nodes(tree, src->key, less, found, greater);
+
+        avl_tree context;
+        context.comp = comp;
+        pool.fork_join([&] { less = intersection_parallel(less, src->left, pool); },
+                       [&] { greater = context.intersection_parallel(greater, src->right, pool); });
+        absorb(context);
+
+        return (found != nullptr) ? join_nodes(less, found, greater) : join_nodes(less, greater);
+    }
+
+    // Number of nodes with key less than the given one, or not greater than it when inclusive is set
+    template <typename K>
+    int rank_helper(const K& key, bool inclusive) const{
+        static_assert(Ranked, "order statistics need a ranked tree, see ranked_avl_tree");
+
+        int result = 0;
+        std::uint64_t key_prefix = prefix_of(key);
+        Node *node = root;
+        while (node != nullptr){
+            int order = compare_node(key, key_prefix, node);
+            if (order < 0 || (order == 0 && !inclusive)){
+                node = node->left;
             }
             else{
-                Node *successor = find_min(node->right);
-                node->key = successor->key;
-                node->info = successor->info;
-                remove_helper(node->right, successor->key);
+                result += count(node->left) + 1;
+                node = node->right;
             }
+        }
 
-            deleted = true;
+        return result;
+    }
+
+    Node* select_node(int index) const{
+        static_assert(Ranked, "order statistics need a ranked tree, see ranked_avl_tree");
+
+        Node *node = root;
+        while (node != nullptr){
+            int left_count = count(node->left);
+            if (index < left_count) node = node->left;
+            else if (index == left_count) break;
+            else{
+                index -= left_count + 1;
+                node = node->right;
+            }
+        }
+
+        return node;
+    }
+
+    template <typename K>
+    bool remove_helper(const K &key)
+    {
+        Node **path[max_height + 1];
+        int depth = 0;
+
+        std::uint64_t key_prefix = prefix_of(key);
+        Node **link = &root;
+        while (*link != nullptr){
+            Node *node = *link;
+            int order = compare_node(key, key_prefix, node);
+            if (order < 0) {
+                path[depth++] = link;
+                link = &node->left;
+            }
+            else if (order > 0) {
+                path[depth++] = link;
+                link = &node->right;
+            }
+            else break;
+        }
+
+        Node *node = *link;
+        if (node == nullptr) return false;
+
+        // Neighbours of an end node are found in O(1): leftmost has no left child and at most a leaf on its right
+        if (node == leftmost) leftmost = next_node(node);
+        if (node == rightmost) rightmost = prev_node(node);
+
+        if (node->left == nullptr || node->right == nullptr){
+            Node *child = (node->left != nullptr) ? node->left : node->right;
+            if (child != nullptr) child->parent = node->parent;
+            *link = child;
+        }
+        else{
+            // Unlink the in-order successor and put it in place of the removed node
+            int node_depth = depth;
+            path[depth++] = link;
+
+            Node **successor_link = &node->right;
+            while ((*successor_link)->left != nullptr){
+                path[depth++] = successor_link;
+                successor_link = &(*successor_link)->left;
+            }
+
+            Node *successor = *successor_link;
+            *successor_link = successor->right;
+            if (successor->right != nullptr) successor->right->parent = successor->parent;
+
+            successor->left = node->left;
+            successor->right = node->right;
+            successor->parent = node->parent;
+            successor->height = node->height;
+            successor->left->parent = successor;
+            if (successor->right != nullptr) successor->right->parent = successor;
+            *link = successor;
+
+            // The link into the removed node's right subtree now belongs to the successor
+            if (depth > node_depth + 1) path[node_depth + 1] = &successor->right;
         }
 
-        node = balance(node);
-        return deleted;
+        alloc.destroy(node);
+        rebalance_path(path, depth);
+        return true;
     }
 
     void printTree(std::ostream &os, Node *node, int indent) const
@@ -223,39 +1289,180 @@ private:
             os << std::setw(indent) << ' ';
             os << node->key << ":" << node->info << "\n";
 
-            // Print left subtree
-            printTree(os, node->left, indent + 6);
+            // Print left subtree
+            printTree(os, node->left, indent + 6);
+        }
+    }
+
+    // In-order neighbours, found through child and parent links in O(1) amortized
+    static Node* next_node(Node* node){
+        if (node->right != nullptr) return find_min(node->right);
+
+        while (node->parent != nullptr && node == node->parent->right) node = node->parent;
+        return node->parent;
+    }
+
+    static Node* prev_node(Node* node){
+        if (node->left != nullptr) return find_max(node->left);
+
+        while (node->parent != nullptr && node == node->parent->left) node = node->parent;
+        return node->parent;
+    }
+
+    template <bool Const>
+    class basic_iterator{
+    public:
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type = Node;
+        using difference_type = std::ptrdiff_t;
+        using pointer = std::conditional_t<Const, const Node*, Node*>;
+        using reference = std::conditional_t<Const, const Node&, Node&>;
+
+        basic_iterator() {}
+
+        // iterator converts to const_iterator
+        template <bool C = Const, typename = std::enable_if_t<C>>
+        basic_iterator(const basic_iterator<false>& other): node(other.node), tree(other.tree) {}
+
+        reference operator*() const { return *node; }
+        pointer operator->() const { return node; }
+
+        basic_iterator& operator++(){
+            node = next_node(node);
+            return *this;
+        }
+
+        basic_iterator operator++(int){
+            basic_iterator old = *this;
+            ++*this;
+            return old;
         }
-    }
 
-    template <typename Fn> void traverse(const Node* node, Fn fn) const {
-        if (node) {
-            traverse(node->left, fn);
-            fn(node->key, node->info);
-            traverse(node->right, fn);
+        // Decrementing end() gives the last element
+        basic_iterator& operator--(){
+            node = (node != nullptr) ? prev_node(node) : tree->rightmost;
+            return *this;
         }
-    }
 
+        basic_iterator operator--(int){
+            basic_iterator old = *this;
+            --*this;
+            return old;
+        }
+
+        friend bool operator==(const basic_iterator& a, const basic_iterator& b) { return a.node == b.node; }
+        friend bool operator!=(const basic_iterator& a, const basic_iterator& b) { return a.node != b.node; }
+
+    private:
+        Node *node = nullptr;
+        const avl_tree *tree = nullptr;
+
+        basic_iterator(Node* node, const avl_tree* tree): node(node), tree(tree) {}
+
+        friend class avl_tree;
+    };
+
+    basic_iterator<false> make_iterator(Node* node) { return basic_iterator<false>(node, this); }
+    basic_iterator<true> make_iterator(Node* node) const { return basic_iterator<true>(node, this); }
 
+    Node* first_node() const { return leftmost; }
 
 public:
+    // Iterators visit elements in key order, each element exposes its key and info fields.
+    // Inserting keeps all iterators valid, removing invalidates only iterators to the removed element.
+    using value_type = Node;
+    using iterator = basic_iterator<false>;
+    using const_iterator = basic_iterator<true>;
+    using reverse_iterator = std::reverse_iterator<iterator>;
+    using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
     avl_tree() {}
 
-    avl_tree(const avl_tree& src) { *this = src; }
+    avl_tree(const avl_tree& src): comp(src.comp) {
+        root = copy_helper(src.root);
+        update_ends();
+    }
+
+    // Takes over nodes and allocator of src in O(1), src is left empty
+    avl_tree(avl_tree&& src) noexcept: root(src.root), leftmost(src.leftmost), rightmost(src.rightmost), size(src.size), comp(std::move(src.comp)), alloc(std::move(src.alloc)) {
+        src.root = src.leftmost = src.rightmost = nullptr;
+        src.size = 0;
+    }
 
     ~avl_tree() { clear(); }
 
     avl_tree& operator=(const avl_tree& src){
         if (this != &src){
             clear();
+            comp = src.comp;
             root = copy_helper(src.root);
-            this->size = src.size;
+            update_ends();
+        }
+
+        return *this;
+    }
+
+    avl_tree& operator=(avl_tree&& src) noexcept{
+        if (this != &src){
+            clear();
+            root = src.root;
+            leftmost = src.leftmost;
+            rightmost = src.rightmost;
+            size = src.size;
+            comp = std::move(src.comp);
+            alloc = std::move(src.alloc);
+
+            src.root = src.leftmost = src.rightmost = nullptr;
+            src.size = 0;
         }
 
         return *this;
     }
 
-    template <typename Fn>void for_each(Fn fn) { for_each(root, fn); }
+    /**
+     * @brief Builds perfectly balanced tree from sorted elements in O(n) without any rotations
+     *
+     * @param first is forward iterator to the first element, either std::pair<Key, Info> or an avl_tree element
+     * @param last is iterator past the last element
+     * @return avl_tree holding all elements
+     * @throw std::invalid_argument if keys are not strictly increasing
+     */
+    template <typename It>
+    static avl_tree build_from_sorted(It first, It last){
+        avl_tree result;
+
+        auto n = std::distance(first, last);
+        for (It prev = first, it = first; it != last; prev = it){
+            if (++it != last && result.compare(avl_detail::element_key(*prev), avl_detail::element_key(*it)) >= 0){
+                throw std::invalid_argument("build_from_sorted: keys are not strictly increasing");
+            }
+        }
+
+        result.root = result.build_helper(first, static_cast<int>(n), nullptr);
+        result.update_ends();
+        result.size = static_cast<int>(n);
+        return result;
+    }
+
+    template <typename Fn>void for_each(Fn fn) {
+        for (Node& node : *this) fn(node.key, node.info);
+    }
+
+    iterator begin() { return make_iterator(first_node()); }
+    const_iterator begin() const { return make_iterator(first_node()); }
+    const_iterator cbegin() const { return begin(); }
+
+    iterator end() { return make_iterator(nullptr); }
+    const_iterator end() const { return make_iterator(nullptr); }
+    const_iterator cend() const { return end(); }
+
+    reverse_iterator rbegin() { return reverse_iterator(end()); }
+    const_reverse_iterator rbegin() const { return const_reverse_iterator(end()); }
+    const_reverse_iterator crbegin() const { return rbegin(); }
+
+    reverse_iterator rend() { return reverse_iterator(begin()); }
+    const_reverse_iterator rend() const { return const_reverse_iterator(begin()); }
+    const_reverse_iterator crend() const { return rend(); }
 
     bool empty() const{
         return size == 0;
@@ -270,8 +1477,13 @@ public:
      *
      */
     void clear(){
-        clear_helper(root);
-        root = nullptr;
+        if constexpr (Allocator<Node>::bulk_release && std::is_trivially_destructible<Node>::value){
+            size = 0;
+        } else {
+            clear_helper(root);
+        }
+        alloc.release_all();
+        root = leftmost = rightmost = nullptr;
     }
 
     /**
@@ -282,8 +1494,110 @@ public:
      * @param onKeyExists is function that will be called if key already exists, by default function returns new info
      */
     void insert(const Key& key, const Info& info) {
-        Node* found_node;
-        insert_helper(root, key, info, found_node);
+        insert_or_assign(key, info);
+    }
+
+    // Same as above, key and info are moved into the tree instead of being copied
+    void insert(Key&& key, Info&& info) {
+        insert_or_assign(std::move(key), std::move(info));
+    }
+
+    /**
+     * @brief Inserts element next to hint or assigns info to the existing one, like insert(key, info).
+     * hint may be the element just after the key, as for std::map, or the element just before it, such as the iterator
+     * returned by the previous call. Then the key is linked in after at most two comparisons, without a search.
+     * Finding the neighbour of hint takes O(1) when hint is end(), the first or the last element, the tree keeps
+     * these ends, and up to O(log n) for other hints. Rebalancing costs amortized O(1) in unranked trees,
+     * so appending with end() or the last element as hint is amortized O(1). Any other hint costs O(log n).
+     *
+     * @param hint is iterator to a neighbour of the key's place
+     * @param key is the key that will be inserted
+     * @param info is info that will be inserted or assigned
+     * @return iterator to the element
+     */
+    template <typename K>
+    iterator insert(const_iterator hint, K&& key, const Info& info){
+        bool inserted;
+        Node *node = insert_hinted(hint.node, std::forward<K>(key), inserted, info);
+        if (!inserted) node->info = info;
+        return make_iterator(node);
+    }
+
+    // Same as above, info is moved into the tree instead of being copied
+    template <typename K>
+    iterator insert(const_iterator hint, K&& key, Info&& info){
+        bool inserted;
+        Node *node = insert_hinted(hint.node, std::forward<K>(key), inserted, std::move(info));
+        if (!inserted) node->info = std::move(info);
+        return make_iterator(node);
+    }
+
+    // Functions below accept keys of any type Compare can compare with Key, e.g. std::string_view for std::string keys
+    // with the default transparent std::less<>. Key itself is constructed only when a new element is inserted.
+
+    /**
+     * @brief Inserts element with info constructed from args if key is not in the tree, otherwise leaves the tree unchanged.
+     * The tree is descended only once.
+     *
+     * @param key is the key that will be searched or inserted, an rvalue key is moved from only if it is inserted
+     * @param args are arguments passed to the constructor of Info
+     * @return std::pair<Info&, bool> info associated with the key and true if element was inserted
+     */
+    template <typename K, typename... Args>
+    std::pair<Info&, bool> try_emplace(K&& key, Args&&... args){
+        bool inserted;
+        Node *node = insert_helper(std::forward<K>(key), inserted, std::forward<Args>(args)...);
+        return {node->info, inserted};
+    }
+
+    /**
+     * @brief Inserts element built in place from key and info if key is not in the tree, otherwise leaves the tree unchanged
+     *
+     * @param key is the key that will be searched or inserted, Key is constructed from it
+     * @param info is what Info is constructed from
+     * @return std::pair<Info&, bool> info associated with the key and true if element was inserted
+     */
+    template <typename K, typename I>
+    std::pair<Info&, bool> emplace(K&& key, I&& info){
+        return try_emplace(std::forward<K>(key), std::forward<I>(info));
+    }
+
+    /**
+     * @brief Inserts element to avl tree or assigns info to the existing one
+     *
+     * @param key is the key that will be inserted
+     * @param info is info that will be inserted or assigned
+     * @return std::pair<Info&, bool> info associated with the key and true if element was inserted
+     */
+    template <typename K>
+    std::pair<Info&, bool> insert_or_assign(K&& key, const Info& info){
+        bool inserted;
+        Node *node = insert_helper(std::forward<K>(key), inserted, info);
+        if (!inserted) node->info = info;
+        return {node->info, inserted};
+    }
+
+    // Same as above, info is moved into the tree instead of being copied
+    template <typename K>
+    std::pair<Info&, bool> insert_or_assign(K&& key, Info&& info){
+        bool inserted;
+        Node *node = insert_helper(std::forward<K>(key), inserted, std::move(info));
+        if (!inserted) node->info = std::move(info);
+        return {node->info, inserted};
+    }
+
+    /**
+     * @brief Updates info of the element in place. If key is not in the tree, element with default constructed info is inserted first.
+     *
+     * @param key is the key that will be searched or inserted
+     * @param fn is function called with Info& of the element
+     * @return std::pair<Info&, bool> info associated with the key and true if element was inserted
+     */
+    template <typename K, typename Fn>
+    std::pair<Info&, bool> upsert(const K& key, Fn fn){
+        std::pair<Info&, bool> result = try_emplace(key);
+        fn(result.first);
+        return result;
     }
 
     /**
@@ -293,8 +1607,9 @@ public:
      * @return true if element was removed
      * @return false if element not exists
      */
-    bool remove(const Key& key){
-        if (remove_helper(root, key)){
+    template <typename K>
+    bool remove(const K& key){
+        if (remove_helper(key)){
             size--;
             return true;
         }
@@ -308,22 +1623,156 @@ public:
      * @return true if element found
      * @return false if element not found
      */
-    bool find(const Key& key) const{
+    template <typename K>
+    bool find(const K& key) const{
         return find_node(root, key) != nullptr;
     }
 
+    /**
+     * @brief searches for element starting at hint instead of the root. The search climbs from hint only until
+     * a subtree holds the key, so a key next to hint is found in O(1) and keys close to it in few steps.
+     *
+     * @param hint is iterator to an element near the key, end() searches from the root
+     * @param key is the key that will be searched
+     * @return iterator to the element or end() if element not found
+     */
+    template <typename K>
+    iterator find_from(const_iterator hint, const K& key){
+        return make_iterator(find_from_node(hint.node, key));
+    }
+
+    template <typename K>
+    const_iterator find_from(const_iterator hint, const K& key) const{
+        return make_iterator(find_from_node(hint.node, key));
+    }
+
+    /**
+     * @brief searches for many keys at once. Lookups advance together and prefetch their next nodes,
+     * on trees larger than the cache this hides most of the memory latency of a loop of find() calls.
+     *
+     * @param keys is pointer to the keys that will be searched
+     * @param count is the number of keys
+     * @param results is pointer to count pointers, results[i] is set to the info of keys[i] or nullptr if it is not in the tree
+     */
+    template <typename K>
+    void find_batch(const K* keys, std::size_t count, Info** results){
+        find_batch_helper(keys, count, results);
+    }
+
+    template <typename K>
+    void find_batch(const K* keys, std::size_t count, const Info** results) const{
+        find_batch_helper(keys, count, results);
+    }
+
+    /**
+     * @brief returns iterator to the first element with key not less than the given one
+     *
+     * @param key is the key that will be searched
+     * @return iterator to the element or end() if all keys are less than key
+     */
+    template <typename K>
+    iterator lower_bound(const K& key) { return make_iterator(lower_bound_node(key)); }
+
+    template <typename K>
+    const_iterator lower_bound(const K& key) const { return make_iterator(lower_bound_node(key)); }
+
+    /**
+     * @brief returns iterator to the first element with key greater than the given one
+     *
+     * @param key is the key that will be searched
+     * @return iterator to the element or end() if no key is greater than key
+     */
+    template <typename K>
+    iterator upper_bound(const K& key) { return make_iterator(upper_bound_node(key)); }
+
+    template <typename K>
+    const_iterator upper_bound(const K& key) const { return make_iterator(upper_bound_node(key)); }
+
+    /**
+     * @brief returns range of elements with the given key, it is empty or holds exactly one element
+     *
+     * @param key is the key that will be searched
+     * @return std::pair of lower_bound(key) and upper_bound(key)
+     */
+    template <typename K>
+    std::pair<iterator, iterator> equal_range(const K& key){
+        iterator first = lower_bound(key);
+        iterator last = first;
+        if (last != end() && compare(key, last->key) == 0) ++last;
+        return {first, last};
+    }
+
+    template <typename K>
+    std::pair<const_iterator, const_iterator> equal_range(const K& key) const{
+        const_iterator first = lower_bound(key);
+        const_iterator last = first;
+        if (last != end() && compare(key, last->key) == 0) ++last;
+        return {first, last};
+    }
+
+    /**
+     * @brief returns position of the key in key order, available in ranked trees only
+     *
+     * @param key is the key that will be searched, it does not have to be in the tree
+     * @return int number of elements with key less than key
+     */
+    template <typename K>
+    int rank(const K& key) const{
+        return rank_helper(key, false);
+    }
+
+    /**
+     * @brief returns element at the given position in key order, available in ranked trees only
+     *
+     * @param index is 0-based position of the element
+     * @return iterator to the element or end() if index is out of range
+     */
+    iterator select(int index) { return make_iterator(select_node(index)); }
+    const_iterator select(int index) const { return make_iterator(select_node(index)); }
+
+    /**
+     * @brief counts elements with key in [lo, hi] in O(log n), available in ranked trees only
+     *
+     * @param lo is the smallest key of the range
+     * @param hi is the largest key of the range
+     * @return int number of elements in the range
+     */
+    template <typename K1, typename K2>
+    int count_range(const K1& lo, const K2& hi) const{
+        int result = rank_helper(hi, true) - rank_helper(lo, false);
+        return std::max(result, 0);
+    }
+
+    /**
+     * @brief calls fn for every element with key in [lo, hi] in key order, costs O(log n + k) for k visited elements
+     *
+     * @param lo is the smallest key of the range
+     * @param hi is the largest key of the range
+     * @param fn is function called with key and info of each element
+     */
+    template <typename K1, typename K2, typename Fn>
+    void for_each_in_range(const K1& lo, const K2& hi, Fn fn){
+        for (iterator it = lower_bound(lo); it != end() && compare(hi, it->key) >= 0; ++it){
+            fn(it->key, it->info);
+        }
+    }
+
+    template <typename K1, typename K2, typename Fn>
+    void for_each_in_range(const K1& lo, const K2& hi, Fn fn) const{
+        for (const_iterator it = lower_bound(lo); it != end() && compare(hi, it->key) >= 0; ++it){
+            fn(it->key, it->info);
+        }
+    }
+
     /**
      * @brief returns info by key
      *
      * @param key is the key that will be searched
      * @return Info& info associated with the key
      */
-    Info& operator[](const Key& key){
-        Node *node = find_node(root, key);
-        if (node == nullptr){
-            insert_helper(root, key, Info(), node);
-        }
-        return node->info;
+    template <typename K>
+    Info& operator[](const K& key){
+        return try_emplace(key).first;
     }
 
     /**
@@ -332,9 +1781,10 @@ public:
      * @param key is the key that will be searched
      * @return const Info& info associated with the key
      */
-    const Info &operator[](const Key &key) const
+    template <typename K>
+    const Info &operator[](const K &key) const
     {
-        Node *node = findNode(root, key);
+        Node *node = find_node(root, key);
         if (node == nullptr)
         {
             throw std::runtime_error("Key not found");
@@ -352,43 +1802,321 @@ public:
     bool is_balanced() { return is_balanced_helper(root); }
 
     template<typename Fn> void traverse(Fn fn) const{
-        traverse(root, fn);
+        for (const Node& node : *this) fn(node.key, node.info);
+    }
+
+    /**
+     * @brief copies the elements into an immutable tree laid out for fast lookups, see frozen_avl_tree.
+     * The copy does not follow later changes of this tree.
+     *
+     * @tparam Frozen is the frozen layout, frozen_kary_tree<Key, Info> is faster for arithmetic keys in natural order
+     * @return Frozen with the same elements and comparator
+     */
+    template <typename Frozen = frozen_avl_tree<Key, Info, Compare>>
+    Frozen freeze() const{
+        return Frozen(begin(), end(), comp);
     }
 
     // Adds up 2 AVL trees. If keys are present in both trees, it updates the info
     // of the first one according to the second tree
-    avl_tree operator+(const avl_tree& src) const {
-        avl_tree result(*this); // Copy first AVL tree
-
-        // Traverse the second AVL tree and add elements to the result
-        src.traverse([&result](const Key& key, const Info& info) {
-            result.insert(key, info);
-        });
+    avl_tree operator+(const avl_tree& src) const & {
+        return set_union(*this, src);
+    }
 
-        return result;
+    // Temporary first tree is reused, only elements of src are copied
+    avl_tree operator+(const avl_tree& src) && {
+        return set_union(std::move(*this), src);
     }
 
     // Removes elements of the first AVL tree by keys of the second tree
-    avl_tree operator-(const avl_tree& src) const {
-        avl_tree result(*this);
+    avl_tree operator-(const avl_tree& src) const & {
+        return set_difference(*this, src);
+    }
+
+    avl_tree operator-(const avl_tree& src) && {
+        return set_difference(std::move(*this), src);
+    }
+
+    // In place versions of the operators above, only elements with new keys are allocated
+    avl_tree& operator+=(const avl_tree& src){
+        merge(src);
+        return *this;
+    }
+
+    avl_tree& operator-=(const avl_tree& src){
+        erase_keys(src);
+        return *this;
+    }
+
+    /**
+     * @brief Adds elements of src to this tree in place, combine(info, src_info) decides info of keys present in both.
+     * Costs O(m log(n/m + 1)) for m elements of src merged into n elements.
+     *
+     * @param src is tree whose elements are added, it is left untouched
+     * @param combine is function called with Info& of element of this tree and const Info& of src element
+     */
+    template <typename Combine>
+    void merge(const avl_tree& src, Combine combine){
+        if (&src == this){
+            avl_tree copy(src);
+            root = union_nodes(root, copy.root, combine);
+        }
+        else root = union_nodes(root, src.root, combine);
+        update_ends();
+    }
 
-        src.traverse([&result](const Key& key, const Info& info) {
-            avl_tree<int, std::string>::Node* foundNode = result.find_node(result.root, key);
-            if (foundNode != nullptr) {
-                result.remove(key);
+    // Merge where elements of src replace elements with the same key
+    void merge(const avl_tree& src){
+        if (&src == this) return;
+        merge(src, [](Info& info, const Info& src_info) { info = src_info; });
+    }
+
+    /**
+     * @brief Adds sorted elements in place, combine(info, element_info) decides info of keys already in the tree.
+     * The node of the previous key is kept as a finger together with its successor. A key that falls between
+     * them is linked in without a search, other keys are searched from the successor upwards only as far as needed.
+     * Rebalancing goes up from the new node and stops where heights stop changing, so runs of keys between two
+     * keys of the tree, or past the largest one, cost amortized O(1) per key in unranked trees.
+     *
+     * @param first is forward iterator to the first element, either std::pair<Key, Info> or an avl_tree element
+     * @param last is iterator past the last element
+     * @param combine is function called with Info& of element of this tree and info of the batch element
+     * @throw std::invalid_argument if keys are not strictly increasing, the tree is not changed then
+     */
+    template <typename It, typename Combine>
+    void insert_sorted_batch(It first, It last, Combine combine){
+        for (It prev = first, it = first; it != last; prev = it){
+            if (++it != last && compare(avl_detail::element_key(*prev), avl_detail::element_key(*it)) >= 0){
+                throw std::invalid_argument("insert_sorted_batch: keys are not strictly increasing");
+            }
+        }
+
+        // finger is the node of the previous key and bound its in-order successor, keys between them need no search
+        Node *finger = nullptr, *bound = first_node();
+        for (; first != last; ++first){
+            const auto &key = avl_detail::element_key(*first);
+            std::uint64_t key_prefix = prefix_of(key);
+            int order = (bound != nullptr) ? compare_node(key, key_prefix, bound) : -1;
+
+            if (order < 0) finger = insert_between(finger, bound, key, avl_detail::element_info(*first));
+            else if (order == 0){
+                combine(bound->info, avl_detail::element_info(*first));
+                finger = bound;
+                bound = next_node(bound);
             }
+            else{
+                bool inserted;
+                finger = insert_near(bound, key, inserted, avl_detail::element_info(*first));
+                if (!inserted) combine(finger->info, avl_detail::element_info(*first));
+                bound = next_node(finger);
+            }
+        }
+    }
+
+    // Sorted batch insert where batch elements replace info of existing keys
+    template <typename It>
+    void insert_sorted_batch(It first, It last){
+        insert_sorted_batch(first, last, [](Info& info, const auto& element_info) { info = element_info; });
+    }
+
+    /**
+     * @brief Removes elements whose keys are in src, in place
+     *
+     * @param src is tree with keys that will be removed, it is left untouched
+     */
+    void erase_keys(const avl_tree& src){
+        if (&src == this) clear();
+        else{
+            root = difference_nodes(root, src.root);
+            update_ends();
+        }
+    }
+
+    /**
+     * @brief Moves all elements of greater to this tree in O(log n), greater is left empty
+     *
+     * @param greater is tree with keys greater than every key of this tree
+     * @throw std::invalid_argument if some key of greater is not greater than all keys of this tree
+     */
+    void join(avl_tree& greater){
+        if (&greater == this || greater.root == nullptr) return;
+
+        if (root != nullptr && compare(rightmost->key, greater.leftmost->key) >= 0){
+            throw std::invalid_argument("join: keys of the trees overlap");
+        }
+
+        alloc.adopt(greater.alloc);
+        root = join_nodes(root, greater.root);
+        if (leftmost == nullptr) leftmost = greater.leftmost;
+        rightmost = greater.rightmost;
+        size += greater.size;
+
+        greater.root = greater.leftmost = greater.rightmost = nullptr;
+        greater.size = 0;
+    }
+
+    /**
+     * @brief Moves elements with key not less than key to the returned tree.
+     * Costs O(log n) for ranked trees, otherwise the moved elements are counted in O(k).
+     * Nodes of pool_allocator cannot leave their pool, such trees copy the moved elements.
+     *
+     * @param key is the smallest key that goes to the returned tree
+     * @return avl_tree with all elements with key not less than key
+     */
+    template <typename K>
+    avl_tree split(const K& key){
+        Node *less, *found, *greater;
+        split_nodes(root, key, less, found, greater);
+        if (found != nullptr) greater = join_nodes(nullptr, found, greater);
+        root = less;
+        update_ends();
+
+        avl_tree result;
+        if constexpr (Allocator<Node>::transferable_nodes){
+            result.root = greater;
+            result.update_ends();
+            if constexpr (Ranked) result.size = count(greater);
+            else result.size = static_cast<int>(std::distance(result.begin(), result.end()));
+            size -= result.size;
+        }
+        else{
+            result.root = result.copy_helper(greater);
+            result.update_ends();
+            clear_helper(greater);
+        }
+
+        return result;
+    }
+
+    /**
+     * @brief returns union of two trees, combine(info, b_info) decides info of keys present in both
+     *
+     * @param a is the first tree
+     * @param b is the second tree
+     * @param combine is function called with Info& of a copied element and const Info& of b element
+     * @return avl_tree with keys of both trees
+     */
+    template <typename Combine>
+    static avl_tree set_union(const avl_tree& a, const avl_tree& b, Combine combine){
+        return set_union(avl_tree(a), b, combine);
+    }
+
+    // Overloads taking a as rvalue work on its nodes in place instead of copying them
+    template <typename Combine>
+    static avl_tree set_union(avl_tree&& a, const avl_tree& b, Combine combine){
+        if (&b == &a){
+            avl_tree copy(a);
+            return set_union(std::move(a), copy, combine);
+        }
+
+        avl_tree result(std::move(a));
+        result.root = result.union_nodes(result.root, b.root, combine);
+        result.update_ends();
+        return result;
+    }
+
+    // Union where elements of b replace elements of a with the same key
+    static avl_tree set_union(const avl_tree& a, const avl_tree& b){
+        return set_union(a, b, [](Info& info, const Info& b_info) { info = b_info; });
+    }
+
+    static avl_tree set_union(avl_tree&& a, const avl_tree& b){
+        return set_union(std::move(a), b, [](Info& info, const Info& b_info) { info = b_info; });
+    }
+
+    // Elements of a whose keys are not in b
+    static avl_tree set_difference(const avl_tree& a, const avl_tree& b){
+        return set_difference(avl_tree(a), b);
+    }
+
+    static avl_tree set_difference(avl_tree&& a, const avl_tree& b){
+        avl_tree result(std::move(a));
+        if (&b == &a) result.clear();
+        else{
+            result.root = result.difference_nodes(result.root, b.root);
+            result.update_ends();
+        }
+        return result;
+    }
+
+    // Elements of a whose keys are also in b
+    static avl_tree set_intersection(const avl_tree& a, const avl_tree& b){
+        return set_intersection(avl_tree(a), b);
+    }
+
+    static avl_tree set_intersection(avl_tree&& a, const avl_tree& b){
+        avl_tree result(std::move(a));
+        if (&b != &a){
+            result.root = result.intersection_nodes(result.root, b.root);
+            result.update_ends();
+        }
+        return result;
+    }
+
+    /**
+     * @brief set_union spread over the threads of pool, copying of a is parallel as well.
+     * combine may be called from several threads at once, for different elements.
+     *
+     * @param a is the first tree
+     * @param b is the second tree
+     * @param pool is task_pool that runs the work, its size sets the number of threads
+     * @param combine is function called with Info& of a copied element and const Info& of b element
+     * @return avl_tree with keys of both trees
+     */
+    template <typename Combine>
+    static avl_tree parallel_union(const avl_tree& a, const avl_tree& b, task_pool& pool, Combine combine){
+        avl_tree result;
+        result.comp = a.comp;
+        pool.run([&] {
+            result.root = result.copy_parallel(a.root, pool);
+            result.root = result.union_parallel(result.root, b.root, combine, pool);
         });
+        result.update_ends();
+        return result;
+    }
+
+    static avl_tree parallel_union(const avl_tree& a, const avl_tree& b, task_pool& pool){
+        return parallel_union(a, b, pool, [](Info& info, const Info& b_info) { info = b_info; });
+    }
 
+    // set_difference spread over the threads of pool
+    static avl_tree parallel_difference(const avl_tree& a, const avl_tree& b, task_pool& pool){
+        avl_tree result;
+        result.comp = a.comp;
+        pool.run([&] {
+            result.root = result.copy_parallel(a.root, pool);
+            result.root = result.difference_parallel(result.root, b.root, pool);
+        });
+        result.update_ends();
         return result;
     }
 
+    // set_intersection spread over the threads of pool
+    static avl_tree parallel_intersection(const avl_tree& a, const avl_tree& b, task_pool& pool){
+        avl_tree result;
+        result.comp = a.comp;
+        pool.run([&] {
+            result.root = result.copy_parallel(a.root, pool);
+            result.root = result.intersection_parallel(result.root, b.root, pool);
+        });
+        result.update_ends();
+        return result;
+    }
 
 };
 
+// avl_tree that keeps subtree sizes in its nodes, which enables rank(), select() and count_range() in O(log n)
+template <typename Key, typename Info, typename Compare = std::less<>, template <typename> class Allocator = heap_allocator>
+using ranked_avl_tree = avl_tree<Key, Info, Compare, Allocator, true>;
+
+// Word counting tree: keys are views of bytes kept in the tree's own arena, so a node needs no
+// allocation of its own and clear() releases nodes and keys in O(1)
+using word_count_tree = avl_tree<std::string_view, int, std::less<>, arena_allocator>;
+
 // External methods
 
-template <typename Key, typename Info>
-std::vector<std::pair<Key, Info>> maxinfo_selector(const avl_tree<Key, Info>& tree, unsigned cnt) {
+template <typename Key, typename Info, typename Compare, template <typename> class Allocator, bool Ranked>
+std::vector<std::pair<Key, Info>> maxinfo_selector(const avl_tree<Key, Info, Compare, Allocator, Ranked>& tree, unsigned cnt) {
     std::vector<std::pair<Key, Info>> result;
 
     // Initialize priority queue to store elements based on info values
@@ -410,13 +2138,79 @@ std::vector<std::pair<Key, Info>> maxinfo_selector(const avl_tree<Key, Info>& tr
     return result;
 }
 
-avl_tree<std::string ,int> count_words(std::istream& is){
+inline avl_tree<std::string ,int> count_words(std::istream& is){
     avl_tree<std::string,int> treeRes;
 
     std::string word;
     while(is >> word){
-        treeRes[word]++;
+        treeRes.upsert(word, [](int& count) { count++; });
     }
 
     return treeRes;
-}
\ No newline at end of file
+}
+
+// Counts words of text like count_words(std::istream&), a word is copied only when it is seen for the first time.
+// Tree may be word_count_tree to keep the words in an arena.
+template <typename Tree = avl_tree<std::string, int>>
+Tree count_words(std::string_view text){
+    Tree tree;
+    for_each_word(text, [&tree](std::string_view word) { tree.upsert(word, [](int& count) { count++; }); });
+    return tree;
+}
+
+/**
+ * @brief Counts words of the file without copying it, the file is memory-mapped and split into words in place
+ *
+ * @param path is path of the file
+ * @return avl_tree with number of occurrences of every word
+ * @throw std::runtime_error if the file cannot be opened
+ */
+template <typename Tree = avl_tree<std::string, int>>
+Tree count_words_file(const std::string& path){
+    mapped_file file(path);
+    return count_words<Tree>(file.view());
+}
+
+namespace avl_detail{
+    // Counts ranges [first, last) of text, the second half of the ranges is offered to other workers of pool
+    inline avl_tree<std::string, int> count_words_ranges(std::string_view text, const std::vector<std::size_t>& bounds,
+                                                         std::size_t first, std::size_t last, task_pool& pool){
+        if (last - first == 1) return count_words(text.substr(bounds[first], bounds[last] - bounds[first]));
+
+        std::size_t middle = first + (last - first) / 2;
+        avl_tree<std::string, int> tree, other;
+        pool.fork_join([&] { tree = count_words_ranges(text, bounds, first, middle, pool); },
+                       [&] { other = count_words_ranges(text, bounds, middle, last, pool); });
+
+        tree.merge(other, [](int& count, const int& other_count) { count += other_count; });
+        return tree;
+    }
+}
+
+/**
+ * @brief Counts words of the file like count_words() does, using several threads.
+ * The mapped file is cut into one range per thread at whitespace, so no word is split.
+ * Every range is counted into a tree of its own, trees are merged pairwise by adding the counts.
+ *
+ * @param path is path of the file
+ * @param threads is the number of threads
+ * @return avl_tree with number of occurrences of every word
+ * @throw std::runtime_error if the file cannot be opened
+ */
+inline avl_tree<std::string, int> count_words_parallel(const std::string& path, unsigned threads = std::thread::hardware_concurrency()){
+    mapped_file file(path);
+    std::string_view text = file.view();
+
+    if (threads == 0) threads = 1;
+    std::vector<std::size_t> bounds;
+    for (unsigned i = 0; i <= threads; ++i){
+        std::size_t bound = text.size() / threads * i + text.size() % threads * i / threads;
+        while (i > 0 && bound < text.size() && !avl_detail::is_space(text[bound])) ++bound;
+        bounds.push_back(bound);
+    }
+
+    task_pool pool(threads);
+    avl_tree<std::string, int> result;
+    pool.run([&] { result = avl_detail::count_words_ranges(text, bounds, 0, threads, pool); });
+    return result;
+}
@@ -1,8 +1,25 @@
+#include <algorithm>
 #include <cassert>
+#include <cctype>
 #include <string>
 #include <sstream>
+#include <string_view>
+#include <cstdio>
+#include <limits>
+#include <random>
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 
 #include "avl_tree.h"
+#include "compact_avl_tree.h"
+#include "persistent_avl_tree.h"
 
 using namespace std;
 
@@ -11,6 +28,17 @@ void print_separator() {
     std::cout << "----------------------" << std::endl;
 }
 
+// True if fn throws Exception
+template <typename Exception, typename Fn>
+bool throws(Fn fn) {
+    try {
+        fn();
+    } catch (const Exception&) {
+        return true;
+    }
+    return false;
+}
+
 void test_clear_get_size()
 {
     avl_tree<int, std::string> tree;
@@ -337,8 +365,1317 @@ void test_subtract_operator() {
     cout<<"Substract operator tests passed"<< endl;
 }
 
+void test_pool_allocator() {
+    avl_tree<int, std::string, std::less<>, pool_allocator> tree;
 
-int test_count_words(){
+    for (int i = 0; i < 5000; ++i) {
+        tree.insert(i, std::to_string(i));
+    }
+    assert(tree.get_size() == 5000);
+    assert(tree.is_balanced());
+
+    for (int i = 0; i < 5000; i += 2) {
+        assert(tree.remove(i));
+    }
+    assert(tree.get_size() == 2500);
+    assert(tree.is_balanced());
+    assert(!tree.find(10));
+    assert(tree[11] == "11");
+
+    // Freed slots are reused by the following inserts
+    for (int i = 0; i < 5000; i += 2) {
+        tree.insert(i, "x");
+    }
+    assert(tree.get_size() == 5000);
+    assert(tree[10] == "x");
+
+    avl_tree<int, std::string, std::less<>, pool_allocator> copy = tree;
+    tree.clear();
+    assert(tree.empty());
+    assert(copy.get_size() == 5000);
+    assert(copy[4999] == "4999");
+
+    // Trivially destructible nodes are released without visiting them
+    avl_tree<int, int, std::less<>, pool_allocator> ints;
+    for (int i = 0; i < 3000; ++i) {
+        ints.insert(i, i * i);
+    }
+    ints.clear();
+    assert(ints.empty());
+    ints.insert(7, 49);
+    assert(ints.get_size() == 1);
+    assert(ints[7] == 49);
+
+    cout << "Pool allocator tests passed!" << endl;
+}
+
+void test_try_emplace_upsert() {
+    avl_tree<int, std::string> tree;
+
+    assert(tree.try_emplace(10, "A").second);
+    assert(tree[10] == "A");
+
+    assert(!tree.try_emplace(10, "B").second);
+    assert(tree[10] == "A");
+
+    assert(tree.try_emplace(5, 3, 'x').second);
+    assert(tree[5] == "xxx");
+
+    assert(!tree.insert_or_assign(10, "C").second);
+    assert(tree[10] == "C");
+
+    auto inserted = tree.insert_or_assign(15, "D");
+    assert(inserted.second);
+    inserted.first += "E";
+    assert(tree[15] == "DE");
+    assert(tree.get_size() == 3);
+    assert(tree.is_balanced());
+
+    avl_tree<std::string, int> wc;
+    assert(wc.upsert("a", [](int& count) { count++; }).second);
+    assert(!wc.upsert("a", [](int& count) { count++; }).second);
+    wc.upsert("b", [](int& count) { count += 5; });
+    assert(wc["a"] == 2);
+    assert(wc["b"] == 5);
+
+    std::istringstream text("to be or not to be");
+    avl_tree<std::string, int> counted = count_words(text);
+    assert(counted.get_size() == 4);
+    assert(counted["to"] == 2);
+    assert(counted["be"] == 2);
+    assert(counted["or"] == 1);
+    assert(counted["not"] == 1);
+
+    cout << "Try_emplace, insert_or_assign and upsert tests passed!" << endl;
+}
+
+void test_heterogeneous_lookup() {
+    avl_tree<std::string, int> tree;
+    std::string_view text = "alpha beta gamma";
+
+    assert(tree.try_emplace(text.substr(0, 5), 1).second);
+    assert(tree.upsert(text.substr(6, 4), [](int& count) { count += 2; }).second);
+    tree[text.substr(11)] = 3;
+    assert(tree.get_size() == 3);
+
+    assert(tree.find(std::string_view("alpha")));
+    assert(tree.find("beta"));
+    assert(!tree.find(std::string_view("alph")));
+    assert(tree[std::string_view("beta")] == 2);
+
+    assert(std::as_const(tree)[std::string_view("gamma")] == 3);
+
+    assert(!tree.upsert(std::string_view("alpha"), [](int& count) { count++; }).second);
+    assert(tree["alpha"] == 2);
+    assert(tree.get_size() == 3);
+
+    assert(tree.remove(std::string_view("beta")));
+    assert(!tree.find("beta"));
+    assert(tree.get_size() == 2);
+
+    cout << "Heterogeneous lookup tests passed!" << endl;
+}
+
+void test_custom_comparator() {
+    avl_tree<int, std::string, std::greater<int>> tree;
+    tree.insert(10, "A");
+    tree.insert(5, "B");
+    tree.insert(15, "C");
+    tree.insert(2, "D");
+    tree.insert(8, "E");
+
+    std::vector<int> keys;
+    tree.for_each([&keys](const int& key, const std::string& info) { keys.push_back(key); });
+    assert((keys == std::vector<int>{15, 10, 8, 5, 2}));
+
+    assert(tree.find(8));
+    assert(tree.remove(10));
+    assert(!tree.find(10));
+    assert(tree.is_balanced());
+
+    // Case-insensitive strings have no compare() of their own, Compare is called twice per level
+    struct case_insensitive_less {
+        bool operator()(const std::string& a, const std::string& b) const {
+            return std::lexicographical_compare(a.begin(), a.end(), b.begin(), b.end(),
+                                                [](char x, char y) { return std::tolower(x) < std::tolower(y); });
+        }
+    };
+    avl_tree<std::string, int, case_insensitive_less> words;
+    words["Apple"] = 1;
+    words["apple"]++;
+    words["BANANA"] = 5;
+    assert(words.get_size() == 2);
+    assert(words["APPLE"] == 2);
+    assert(words.find(std::string("banana")));
+
+    cout << "Custom comparator tests passed!" << endl;
+}
+
+void test_iterators() {
+    avl_tree<int, std::string> tree;
+    assert(tree.begin() == tree.end());
+    assert(tree.rbegin() == tree.rend());
+
+    tree.insert(10, "A");
+    tree.insert(5, "B");
+    tree.insert(15, "C");
+    tree.insert(2, "D");
+    tree.insert(8, "E");
+    tree.insert(12, "F");
+    tree.insert(18, "G");
+
+    std::vector<int> keys;
+    for (const auto& element : tree) keys.push_back(element.key);
+    assert((keys == std::vector<int>{2, 5, 8, 10, 12, 15, 18}));
+
+    keys.clear();
+    for (auto it = tree.rbegin(); it != tree.rend(); ++it) keys.push_back(it->key);
+    assert((keys == std::vector<int>{18, 15, 12, 10, 8, 5, 2}));
+
+    auto last = tree.end();
+    --last;
+    assert(last->key == 18);
+    assert(std::distance(tree.begin(), tree.end()) == 7);
+
+    // Stopping early, something traverse cannot do
+    auto it = std::find_if(tree.begin(), tree.end(), [](const auto& element) { return element.info == "F"; });
+    assert(it != tree.end() && it->key == 12);
+    it->info = "Z";
+    assert(tree[12] == "Z");
+
+    // Iterators stay valid while other elements are inserted and removed
+    tree.insert(11, "H");
+    tree.remove(2);
+    tree.remove(18);
+    assert(it->key == 12);
+    assert((--it)->key == 11);
+
+    // iterator converts to const_iterator
+    assert((avl_tree<int, std::string>::const_iterator(tree.begin()) == std::as_const(tree).begin()));
+    assert(std::as_const(tree).begin()->key == 5);
+
+    cout << "Iterator tests passed!" << endl;
+}
+
+void test_range_queries() {
+    avl_tree<int, std::string> tree;
+    assert(tree.lower_bound(5) == tree.end());
+
+    for (int key = 10; key <= 100; key += 10) {
+        tree.insert(key, std::to_string(key));
+    }
+
+    assert(tree.lower_bound(30)->key == 30);
+    assert(tree.lower_bound(31)->key == 40);
+    assert(tree.lower_bound(0)->key == 10);
+    assert(tree.lower_bound(101) == tree.end());
+
+    assert(tree.upper_bound(30)->key == 40);
+    assert(tree.upper_bound(29)->key == 30);
+    assert(tree.upper_bound(100) == tree.end());
+
+    assert(tree.equal_range(50).first->key == 50);
+    assert(tree.equal_range(50).second->key == 60);
+    assert(tree.equal_range(55).first == tree.equal_range(55).second);
+    assert(tree.equal_range(55).first->key == 60);
+
+    std::vector<int> keys;
+    tree.for_each_in_range(25, 70, [&keys](const int& key, std::string& info) {
+        keys.push_back(key);
+        info += "!";
+    });
+    assert((keys == std::vector<int>{30, 40, 50, 60, 70}));
+    assert(tree[70] == "70!");
+    assert(tree[80] == "80");
+
+    const avl_tree<int, std::string>& const_tree = tree;
+    keys.clear();
+    const_tree.for_each_in_range(90, 1000, [&keys](const int& key, const std::string& info) { keys.push_back(key); });
+    assert((keys == std::vector<int>{90, 100}));
+
+    keys.clear();
+    const_tree.for_each_in_range(41, 49, [&keys](const int& key, const std::string& info) { keys.push_back(key); });
+    assert(keys.empty());
+
+    avl_tree<std::string, int> words;
+    words["apple"] = 1;
+    words["banana"] = 2;
+    words["cherry"] = 3;
+    assert(words.lower_bound(std::string_view("b"))->key == "banana");
+    assert(words.upper_bound("banana")->key == "cherry");
+
+    cout << "Range query tests passed!" << endl;
+}
+
+void test_order_statistics() {
+    ranked_avl_tree<int, std::string> tree;
+    assert(tree.rank(5) == 0);
+    assert(tree.select(0) == tree.end());
+    assert(tree.count_range(0, 100) == 0);
+
+    for (int key = 100; key >= 1; --key) {
+        tree.insert(key * 10, std::to_string(key));
+    }
+    assert(tree.is_balanced());
+
+    assert(tree.rank(10) == 0);
+    assert(tree.rank(15) == 1);
+    assert(tree.rank(500) == 49);
+    assert(tree.rank(5000) == 100);
+    for (int index = 0; index < 100; ++index) {
+        assert(tree.select(index)->key == (index + 1) * 10);
+    }
+    assert(tree.select(100) == tree.end());
+    assert(tree.select(-1) == tree.end());
+
+    assert(tree.count_range(10, 1000) == 100);
+    assert(tree.count_range(15, 45) == 3);
+    assert(tree.count_range(20, 40) == 3);
+    assert(tree.count_range(41, 49) == 0);
+    assert(tree.count_range(50, 10) == 0);
+
+    // Sizes are kept up to date through removals and their rotations
+    for (int key = 20; key <= 1000; key += 20) {
+        assert(tree.remove(key));
+    }
+    assert(tree.is_balanced());
+    assert(tree.rank(500) == 25);
+    assert(tree.select(25)->key == 510);
+    assert(tree.count_range(100, 200) == 5);
+
+    ranked_avl_tree<int, std::string> copy = tree;
+    copy.insert(15, "x");
+    assert(copy.rank(30) == 2);
+    assert(tree.rank(30) == 1);
+    assert(copy.select(1)->key == 15);
+
+    ranked_avl_tree<std::string, int> words;
+    words["delta"] = 4;
+    words["alpha"] = 1;
+    words["charlie"] = 3;
+    words["bravo"] = 2;
+    assert(words.rank(std::string_view("charlie")) == 2);
+    assert(words.select(3)->key == "delta");
+
+    cout << "Order statistics tests passed!" << endl;
+}
+
+void test_build_from_sorted() {
+    std::vector<std::pair<int, std::string>> sorted;
+    for (int key = 1; key <= 1000; ++key) {
+        sorted.emplace_back(key * 2, std::to_string(key));
+    }
+
+    auto tree = avl_tree<int, std::string>::build_from_sorted(sorted.begin(), sorted.end());
+    assert(tree.get_size() == 1000);
+    assert(tree.is_balanced());
+    assert(tree[2] == "1");
+    assert(tree[2000] == "1000");
+    assert(!tree.find(3));
+    assert(std::equal(tree.begin(), tree.end(), sorted.begin(), [](const auto& element, const auto& pair) {
+        return element.key == pair.first && element.info == pair.second;
+    }));
+
+    // Built tree behaves like any other one
+    tree.insert(3, "x");
+    assert(tree.remove(1000));
+    assert(tree.is_balanced());
+    assert(tree.get_size() == 1000);
+
+    // Elements of another tree are accepted as well, subtree sizes are filled in
+    auto ranked = ranked_avl_tree<int, std::string>::build_from_sorted(tree.begin(), tree.end());
+    assert(ranked.get_size() == 1000);
+    assert(ranked.select(1)->key == 3);
+    assert(ranked.rank(2000) == 999);
+
+    auto empty = avl_tree<int, std::string>::build_from_sorted(sorted.end(), sorted.end());
+    assert(empty.empty());
+
+    std::swap(sorted[10], sorted[11]);
+    assert(throws<std::invalid_argument>([&sorted] {
+        avl_tree<int, std::string>::build_from_sorted(sorted.begin(), sorted.end());
+    }));
+
+    cout << "Build from sorted tests passed!" << endl;
+}
+
+void test_join_split() {
+    avl_tree<int, std::string> tree;
+    for (int key = 1; key <= 100; ++key) {
+        tree.insert(key, std::to_string(key));
+    }
+
+    avl_tree<int, std::string> upper = tree.split(40);
+    assert(tree.get_size() == 39);
+    assert(upper.get_size() == 61);
+    assert(tree.is_balanced() && upper.is_balanced());
+    assert((--tree.end())->key == 39);
+    assert(upper.begin()->key == 40);
+
+    avl_tree<int, std::string> top = upper.split(1000);
+    assert(top.empty());
+    assert(upper.get_size() == 61);
+
+    // Join accepts trees of very different heights
+    avl_tree<int, std::string> small;
+    small.insert(500, "x");
+    upper.join(small);
+    assert(small.empty());
+    assert(upper.get_size() == 62);
+    assert(upper.is_balanced());
+
+    tree.join(upper);
+    assert(upper.empty());
+    assert(tree.get_size() == 101);
+    assert(tree.is_balanced());
+    assert(tree[40] == "40");
+    assert(tree[500] == "x");
+
+    avl_tree<int, std::string> overlapping;
+    overlapping.insert(50, "y");
+    assert(throws<std::invalid_argument>([&] { tree.join(overlapping); }));
+    assert(overlapping.get_size() == 1);
+
+    // Ranked trees keep subtree sizes, pooled ones copy the split part into a pool of its own
+    ranked_avl_tree<int, int, std::less<>, pool_allocator> ranked;
+    for (int key = 0; key < 1000; ++key) {
+        ranked.insert(key, key);
+    }
+    auto ranked_upper = ranked.split(250);
+    assert(ranked.get_size() == 250);
+    assert(ranked_upper.get_size() == 750);
+    assert(ranked_upper.rank(300) == 50);
+    ranked.join(ranked_upper);
+    assert(ranked.get_size() == 1000);
+    assert(ranked.select(600)->key == 600);
+
+    cout << "Join and split tests passed!" << endl;
+}
+
+void test_set_operations() {
+    avl_tree<int, int> evens, thirds;
+    for (int key = 0; key < 300; key += 2) evens.insert(key, 1);
+    for (int key = 0; key < 300; key += 3) thirds.insert(key, 10);
+
+    auto sum = avl_tree<int, int>::set_union(evens, thirds, [](int& info, const int& other) { info += other; });
+    assert(sum.get_size() == 200);
+    assert(sum.is_balanced());
+    assert(sum[6] == 11);
+    assert(sum[4] == 1);
+    assert(sum[9] == 10);
+
+    auto common = avl_tree<int, int>::set_intersection(evens, thirds);
+    assert(common.get_size() == 50);
+    assert(common.is_balanced());
+    assert(common.find(12) && !common.find(4) && !common.find(9));
+    assert(common[12] == 1);
+
+    auto only_evens = avl_tree<int, int>::set_difference(evens, thirds);
+    assert(only_evens.get_size() == 100);
+    assert(only_evens.is_balanced());
+    assert(!only_evens.find(6) && only_evens.find(4));
+
+    // Disjoint and lopsided operands
+    avl_tree<int, int> high;
+    high.insert(1000, 7);
+    auto joined = evens + high;
+    assert(joined.get_size() == 151);
+    assert((--joined.end())->key == 1000);
+    assert((evens - high).get_size() == 150);
+    assert((high - evens).get_size() == 1);
+
+    avl_tree<int, int> empty;
+    assert((evens + empty).get_size() == 150);
+    assert((empty + evens).get_size() == 150);
+    assert((avl_tree<int, int>::set_intersection(empty, evens).empty()));
+
+    // Operands are left untouched
+    assert(evens.get_size() == 150 && thirds.get_size() == 100);
+    assert(evens[6] == 1);
+
+    cout << "Set operation tests passed!" << endl;
+}
+
+void test_move_semantics() {
+    avl_tree<int, std::string> words;
+    for (int key = 0; key < 100; ++key) words.insert(key, std::to_string(key));
+    std::string& first = words.begin()->info;
+
+    // Moving takes the nodes over, the old node is still the one in the tree
+    avl_tree<int, std::string> moved(std::move(words));
+    first = "moved";
+    assert(moved.get_size() == 100 && moved[0] == "moved");
+    assert(words.empty() && words.begin() == words.end());
+
+    avl_tree<int, std::string> assigned;
+    assigned.insert(500, "gone");
+    assigned = std::move(moved);
+    first = "assigned";
+    assert(assigned.get_size() == 100 && assigned[0] == "assigned");
+    assert(!assigned.find(500));
+    assert(moved.empty());
+
+    // Moved from tree is still usable
+    moved.insert(1, "one");
+    assert(moved.get_size() == 1 && moved[1] == "one");
+
+    // Move only info is moved into the tree
+    avl_tree<std::string, std::unique_ptr<int>> owners;
+    std::string key = "a key long enough to live on the heap";
+    auto value = std::make_unique<int>(7);
+    owners.insert(std::move(key), std::move(value));
+    assert(value == nullptr);
+    assert(*owners["a key long enough to live on the heap"] == 7);
+    owners.insert(std::string("a key long enough to live on the heap"), std::make_unique<int>(8));
+    assert(owners.get_size() == 1 && *owners["a key long enough to live on the heap"] == 8);
+
+    assert(owners.emplace(std::string("b"), std::make_unique<int>(1)).second && *owners["b"] == 1);
+    assert(!owners.emplace("b", std::make_unique<int>(2)).second && *owners["b"] == 1);
+
+    // Rvalue left operand of + and - is reused in place
+    avl_tree<int, int> evens, thirds;
+    for (int key = 0; key < 300; key += 2) evens.insert(key, 1);
+    for (int key = 0; key < 300; key += 3) thirds.insert(key, 10);
+    avl_tree<int, int> left(evens);
+    int& zero = left.begin()->info;
+    int& two = left.lower_bound(2)->info;
+    auto sum = std::move(left) + thirds;
+    zero = -1;
+    assert(sum.get_size() == 200 && sum.is_balanced());
+    assert(sum[0] == -1 && sum[6] == 10);
+
+    auto difference = std::move(sum) - thirds;
+    two = -2;
+    assert(difference.get_size() == 100 && difference.is_balanced());
+    assert(difference[2] == -2 && !difference.find(6) && difference.find(4));
+
+    // Operands that alias each other
+    avl_tree<int, int> self(evens);
+    auto doubled = avl_tree<int, int>::set_union(std::move(self), self, [](int& info, const int& other) { info += other; });
+    assert(doubled.get_size() == 150 && doubled[4] == 2);
+
+    // Pooled trees move their whole pool
+    avl_tree<int, int, std::less<>, pool_allocator> pooled;
+    for (int key = 0; key < 5000; ++key) pooled.insert(key, key);
+    auto pooled_moved = std::move(pooled);
+    assert(pooled_moved.get_size() == 5000 && pooled_moved[4999] == 4999);
+    pooled.insert(3, 3);
+    pooled = std::move(pooled_moved);
+    assert(pooled.get_size() == 5000 && !pooled_moved.find(3));
+    pooled_moved.insert(1, 1);
+    assert(pooled_moved.get_size() == 1);
+
+    cout << "Move semantics tests passed!" << endl;
+}
+
+void test_in_place_set_operations() {
+    avl_tree<std::string, int> total;
+    total.insert("apple", 3);
+    total.insert("pear", 1);
+    int& apple = total.begin()->info;
+
+    avl_tree<std::string, int> delta;
+    delta.insert("apple", 2);
+    delta.insert("plum", 5);
+
+    total.merge(delta, [](int& info, const int& other) { info += other; });
+    assert(total.get_size() == 3 && total.is_balanced());
+    assert(total["apple"] == 5 && total["pear"] == 1 && total["plum"] == 5);
+    // Existing elements stay where they are
+    apple = 6;
+    assert(total["apple"] == 6);
+    assert(delta.get_size() == 2 && delta["apple"] == 2);
+
+    total += delta;
+    assert(total.get_size() == 3 && total["apple"] == 2);
+
+    total -= delta;
+    assert(total.get_size() == 1 && total.find("pear"));
+    assert(delta.get_size() == 2);
+
+    // Larger trees against the copying operators
+    avl_tree<int, int> evens, thirds;
+    for (int key = 0; key < 3000; key += 2) evens.insert(key, 1);
+    for (int key = 0; key < 3000; key += 3) thirds.insert(key, 10);
+    avl_tree<int, int> merged(evens);
+    merged += thirds;
+    assert(merged.get_size() == (evens + thirds).get_size() && merged.is_balanced());
+    assert(merged[6] == 10 && merged[4] == 1);
+
+    avl_tree<int, int> erased(evens);
+    erased.erase_keys(thirds);
+    assert(erased.get_size() == (evens - thirds).get_size() && erased.is_balanced());
+    assert(!erased.find(6) && erased.find(4));
+
+    // Tree combined with itself
+    avl_tree<int, int> self(evens);
+    self.merge(self, [](int& info, const int& other) { info += other; });
+    assert(self.get_size() == 1500 && self[4] == 2);
+    self += self;
+    assert(self.get_size() == 1500 && self[4] == 2);
+    self -= self;
+    assert(self.empty());
+
+    // Pooled trees allocate new elements from their own pool
+    avl_tree<int, int, std::less<>, pool_allocator> pooled, pooled_delta;
+    for (int key = 0; key < 1000; ++key) pooled.insert(key, key);
+    for (int key = 500; key < 1500; ++key) pooled_delta.insert(key, -key);
+    pooled += pooled_delta;
+    pooled_delta.clear();
+    assert(pooled.get_size() == 1500 && pooled[700] == -700 && pooled[1499] == -1499);
+
+    cout << "In place set operation tests passed!" << endl;
+}
+
+void test_parallel_set_operations() {
+    std::vector<std::pair<int, int>> evens, thirds;
+    for (int key = 0; key < 200000; key += 2) evens.emplace_back(key, 1);
+    for (int key = 0; key < 300000; key += 3) thirds.emplace_back(key, 10);
+    auto a = avl_tree<int, int>::build_from_sorted(evens.begin(), evens.end());
+    auto b = avl_tree<int, int>::build_from_sorted(thirds.begin(), thirds.end());
+
+    task_pool pool(4);
+    assert(pool.get_threads() == 4);
+
+    auto sum = avl_tree<int, int>::parallel_union(a, b, pool, [](int& info, const int& other) { info += other; });
+    auto expected_sum = avl_tree<int, int>::set_union(a, b, [](int& info, const int& other) { info += other; });
+    assert(sum.get_size() == expected_sum.get_size());
+    assert(sum.is_balanced());
+    assert(std::equal(sum.begin(), sum.end(), expected_sum.begin(), [](const auto& x, const auto& y) {
+        return x.key == y.key && x.info == y.info;
+    }));
+    assert(sum[6] == 11);
+
+    auto difference = avl_tree<int, int>::parallel_difference(a, b, pool);
+    assert(difference.get_size() == (a - b).get_size());
+    assert(difference.is_balanced());
+    assert(!difference.find(6) && difference.find(4));
+
+    auto common = avl_tree<int, int>::parallel_intersection(a, b, pool);
+    assert((common.get_size() == avl_tree<int, int>::set_intersection(a, b).get_size()));
+    assert(common.is_balanced());
+    assert(common.find(12) && !common.find(4) && !common.find(9));
+
+    // Pooled trees merge the pools of all tasks into the result
+    avl_tree<int, int, std::less<>, pool_allocator> pa, pb;
+    for (int key = 0; key < 50000; ++key) pa.insert(key, key);
+    for (int key = 25000; key < 75000; ++key) pb.insert(key, -key);
+    auto pooled = avl_tree<int, int, std::less<>, pool_allocator>::parallel_union(pa, pb, pool);
+    assert(pooled.get_size() == 75000);
+    assert(pooled.is_balanced());
+    assert(pooled[30000] == -30000 && pooled[100] == 100);
+    pooled.clear();
+    assert(pooled.empty());
+
+    // Single thread pools run everything inline
+    task_pool single(1);
+    assert((avl_tree<int, int>::parallel_union(a, b, single).get_size() == (a + b).get_size()));
+
+    cout << "Parallel set operation tests passed!" << endl;
+}
+
+// Every word with its count is the same in both trees
+bool same_counts(const avl_tree<std::string, int>& a, const avl_tree<std::string, int>& b){
+    return a.get_size() == b.get_size() && std::equal(a.begin(), a.end(), b.begin(), [](const auto& x, const auto& y) {
+        return x.key == y.key && x.info == y.info;
+    });
+}
+
+void test_count_words_parallel() {
+    const char* path = "count_words_parallel_test.txt";
+    {
+        std::ofstream os(path, std::ios::binary);
+        os << "  to be\tor not\r\nto be,\v\fthat is\n\n the question ";
+        for (int i = 0; i < 20000; ++i) os << "word" << i % 97 << (i % 5 == 0 ? "\n" : " ");
+        os << std::string(70000, 'x') << " tail";
+    }
+
+    std::ifstream is(path);
+    avl_tree<std::string, int> expected = count_words(is);
+    assert(expected["to"] == 2 && expected["be,"] == 1);
+
+    for (unsigned threads = 1; threads <= 9; ++threads){
+        assert(same_counts(count_words_parallel(path, threads), expected));
+    }
+
+    {
+        std::ofstream os(path, std::ios::binary);
+    }
+    assert(count_words_parallel(path, 4).empty());
+    {
+        std::ofstream os(path, std::ios::binary);
+        os << "first word";
+    }
+    assert(count_words_parallel(path, 3)["first"] == 1);
+    std::remove(path);
+
+    assert(throws<std::runtime_error>([] { count_words_parallel("no_such_file.txt", 2); }));
+
+    cout << "Parallel word count tests passed!" << endl;
+}
+
+void test_mapped_count_words() {
+    std::vector<std::string> words;
+    for_each_word("\t to be  or\nnot\r\n\v\fto-be ", [&words](std::string_view word) { words.emplace_back(word); });
+    assert((words == std::vector<std::string>{"to", "be", "or", "not", "to-be"}));
+
+    words.clear();
+    for_each_word("  \n ", [&words](std::string_view word) { words.emplace_back(word); });
+    for_each_word("", [&words](std::string_view word) { words.emplace_back(word); });
+    assert(words.empty());
+
+    std::string text = "to be or not to be, that is the question";
+    std::istringstream is(text);
+    assert(same_counts(count_words(std::string_view(text)), count_words(is)));
+
+    std::ifstream book("beagle_voyage.txt");
+    assert(same_counts(count_words_file("beagle_voyage.txt"), count_words(book)));
+
+    const char* path = "mapped_file_test.txt";
+    {
+        std::ofstream os(path, std::ios::binary);
+    }
+    {
+        mapped_file empty(path);
+        assert(empty.size() == 0 && empty.view().empty());
+        assert(count_words_file(path).empty());
+    }
+    {
+        std::ofstream os(path, std::ios::binary);
+        os << "last word without newline";
+    }
+    {
+        mapped_file file(path);
+        assert(file.view() == "last word without newline");
+        assert(count_words_file(path)["newline"] == 1);
+    }
+    std::remove(path);
+
+    assert(throws<std::runtime_error>([] { mapped_file missing("no_such_file.txt"); }));
+
+    cout << "Mapped word count tests passed!" << endl;
+}
+
+std::vector<std::string_view> split_words(std::string_view text, avl_detail::whitespace_masks_fn masks_of){
+    std::vector<std::string_view> words;
+    for_each_word(text, [&words](std::string_view word) { words.push_back(word); }, masks_of);
+    return words;
+}
+
+void test_simd_word_scan() {
+    std::vector<avl_detail::whitespace_masks_fn> scanners = {nullptr, avl_detail::best_whitespace_masks()};
+#if WORD_SCAN_X86
+    scanners.push_back(avl_detail::whitespace_masks_sse2);
+    if (__builtin_cpu_supports("avx2")) scanners.push_back(avl_detail::whitespace_masks_avx2);
+#endif
+
+    // Random text of all byte values, whitespace made more frequent, at lengths around the 64 byte blocks
+    std::mt19937 rng(16);
+    const char white[] = {' ', '\t', '\n', '\v', '\f', '\r'};
+    for (int length = 0; length < 300; ++length){
+        for (int round = 0; round < 10; ++round){
+            std::string text(length, ' ');
+            for (char& c : text) c = (rng() % 3 == 0) ? white[rng() % 6] : static_cast<char>(rng() % 256);
+            // Words that run across block bounds
+            if (round == 0) std::fill(text.begin(), text.end(), 'w');
+
+            std::vector<std::string_view> expected;
+            for_each_word_scalar(text, [&expected](std::string_view word) { expected.push_back(word); });
+            assert(std::all_of(scanners.begin(), scanners.end(), [&](auto scanner) { return split_words(text, scanner) == expected; }));
+        }
+    }
+
+    // Views point into the text and match operator>> on the book
+    std::ifstream is("beagle_voyage.txt", std::ios::binary);
+    std::string book((std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
+    std::istringstream stream(book);
+    std::string word;
+    std::vector<std::string> expected;
+    while (stream >> word) expected.push_back(word);
+    auto words = split_words(book, avl_detail::best_whitespace_masks());
+    assert(std::equal(words.begin(), words.end(), expected.begin(), expected.end()));
+    assert(words[0].data() >= book.data() && words.back().data() < book.data() + book.size());
+
+    cout << "SIMD word scan tests passed (" << word_scan_name() << ")!" << endl;
+}
+
+void test_string_arena() {
+    word_count_tree tree;
+    std::string word = "a word longer than the small string buffer";
+    tree.insert(word, 1);
+    tree.upsert(std::string_view("short"), [](int& count) { count += 2; });
+    tree.try_emplace("empty");
+    tree.insert(std::string_view(), 4);
+
+    // Keys are copies owned by the tree
+    assert(tree.begin()->key.empty() && tree.find(""));
+    assert(tree.lower_bound(word)->key.data() != word.data());
+    word[0] = 'A';
+    assert(tree.find("a word longer than the small string buffer") && !tree.find(word));
+    assert(tree["short"] == 2 && tree[std::string("empty")] == 0);
+
+    // Keys larger than an arena chunk get a chunk of their own
+    std::string huge(200000, 'h');
+    tree.insert(huge, 5);
+    assert(tree[huge] == 5 && tree.get_size() == 5);
+    assert(tree.remove("short") && !tree.find("short"));
+
+    // Copies store their own keys, the source may go away
+    word_count_tree copy;
+    {
+        word_count_tree source(tree);
+        source.insert("source only", 6);
+        copy = source;
+        assert(copy.lower_bound("source")->key.data() != source.lower_bound("source")->key.data());
+    }
+    assert(copy.get_size() == 5 && copy["source only"] == 6 && copy[huge] == 5);
+
+    // Joined, split and merged trees take keys along
+    word_count_tree greater;
+    greater.insert("zz top", 7);
+    copy.join(greater);
+    assert(copy["zz top"] == 7);
+    word_count_tree upper = copy.split("m");
+    assert(copy.get_size() == 4 && upper.get_size() == 2);
+    copy += upper;
+    upper.clear();
+    assert(copy.get_size() == 6 && copy["zz top"] == 7 && copy.is_balanced());
+
+    // Cleared arena is reused
+    tree.clear();
+    assert(tree.empty());
+    tree.insert("again", 8);
+    assert(tree["again"] == 8 && tree.get_size() == 1);
+
+    std::ifstream is("beagle_voyage.txt");
+    auto expected = count_words(is);
+    auto arena_counts = count_words_file<word_count_tree>("beagle_voyage.txt");
+    assert(static_cast<int>(arena_counts.get_size()) == expected.get_size());
+    assert(std::equal(arena_counts.begin(), arena_counts.end(), expected.begin(), [](const auto& x, const auto& y) {
+        return x.key == y.key && x.info == y.info;
+    }));
+
+    cout << "String arena tests passed!" << endl;
+}
+
+void test_key_prefix() {
+    using avl_detail::key_prefix;
+    assert(key_prefix("") == 0);
+    assert(key_prefix("a") == 0x6100000000000000ull);
+    assert(key_prefix("abcdefgh") == 0x6162636465666768ull);
+    assert(key_prefix("abcdefghij") == key_prefix("abcdefgh"));
+    assert(key_prefix("\xff") > key_prefix("a"));
+    assert(key_prefix("a") == key_prefix(std::string_view("a\0", 2)));
+
+    // Prefixes agree with the order of the keys for random keys with shared starts, zero bytes and high bytes
+    std::mt19937 rng(18);
+    std::vector<std::string> keys;
+    for (int i = 0; i < 2000; ++i){
+        std::string key = (i % 2 == 0) ? "shared-start-" : "";
+        int length = rng() % 12;
+        for (int c = 0; c < length; ++c) key += static_cast<char>("a\0\xff z"[rng() % 5]);
+        keys.push_back(key);
+    }
+    for (int i = 0; i + 1 < static_cast<int>(keys.size()); ++i){
+        std::uint64_t a = key_prefix(keys[i]), b = key_prefix(keys[i + 1]);
+        if (a != b) assert((a < b) == (keys[i] < keys[i + 1]));
+    }
+
+    avl_tree<std::string, int, prefix_less> tree;
+    std::map<std::string, int> expected;
+    for (int i = 0; i < static_cast<int>(keys.size()); ++i){
+        tree.upsert(keys[i], [i](int& info) { info += i; });
+        expected[keys[i]] += i;
+        if (i % 3 == 0){
+            std::string victim = keys[rng() % keys.size()];
+            assert(tree.remove(victim) == (expected.erase(victim) > 0));
+        }
+    }
+    assert(tree.get_size() == static_cast<int>(expected.size()) && tree.is_balanced());
+    assert(std::equal(tree.begin(), tree.end(), expected.begin(), [](const auto& x, const auto& y) {
+        return x.key == y.first && x.info == y.second;
+    }));
+    for (const std::string& key : keys){
+        assert(tree.find(key) == (expected.count(key) > 0));
+        auto expected_bound = expected.lower_bound(key);
+        if (expected_bound == expected.end()) assert(tree.lower_bound(std::string_view(key)) == tree.end());
+        else assert(tree.lower_bound(std::string_view(key))->key == expected_bound->first);
+    }
+
+    // Copies, set operations and arena keys keep prefixes of their own nodes
+    auto copy = tree + tree;
+    assert(copy.get_size() == tree.get_size() && copy.find("shared-start-"));
+    avl_tree<std::string_view, int, prefix_less, arena_allocator> arena;
+    arena.insert(std::string("shared-start-zz"), 1);
+    arena.insert("shared-start-a", 2);
+    arena.insert("b", 3);
+    assert(arena.begin()->key == "b" && arena["shared-start-a"] == 2 && !arena.find("shared-start-"));
+
+    cout << "Key prefix tests passed!" << endl;
+}
+
+void test_compact_tree() {
+    assert((compact_avl_tree<int, int>::node_bytes <= 16));
+
+    compact_avl_tree<int, int> tree;
+    assert(tree.empty() && !tree.find(1) && tree.is_balanced());
+
+    std::mt19937 rng(19);
+    std::map<int, int> expected;
+    for (int i = 0; i < 20000; ++i){
+        int key = rng() % 3000;
+        switch (rng() % 4){
+            case 0: tree.insert(key, i); expected[key] = i; break;
+            case 1: tree.upsert(key, [](int& info) { info++; }); expected[key]++; break;
+            case 2: assert(tree.remove(key) == (expected.erase(key) > 0)); break;
+            default: assert(tree.find(key) == (expected.count(key) > 0));
+        }
+        if (i % 1000 == 0) assert(tree.is_balanced());
+    }
+    assert(tree.get_size() == static_cast<int>(expected.size()));
+    assert(tree.is_balanced());
+
+    auto it = expected.begin();
+    tree.traverse([&it](const int& key, const int& info) {
+        assert(key == it->first && info == it->second);
+        ++it;
+    });
+    assert(it == expected.end());
+
+    tree.for_each([](const int&, int& info) { info = -info; });
+    assert(tree[expected.begin()->first] == -expected.begin()->second);
+
+    // Copies are independent
+    compact_avl_tree<int, int> copy(tree);
+    copy.clear();
+    assert(copy.empty() && tree.get_size() == static_cast<int>(expected.size()));
+    assert(throws<std::runtime_error>([&tree] { std::as_const(tree)[100000]; }));
+
+    // Removing everything frees all nodes, new elements reuse them
+    assert([&] {
+        std::size_t memory = tree.memory_usage();
+        for (const auto& element : expected) tree.remove(element.first);
+        if (!tree.empty()) return false;
+        for (int key = 0; key < static_cast<int>(expected.size()); ++key) tree.insert(key, key);
+        return tree.memory_usage() == memory;
+    }());
+    assert(tree.is_balanced());
+
+    // Non trivial keys
+    compact_avl_tree<std::string, int> words;
+    words["b"] = 2;
+    words["a"] = 1;
+    words.insert("c", 3);
+    assert(words.remove("b") && words.get_size() == 2 && words["c"] == 3);
+
+    cout << "Compact tree tests passed!" << endl;
+}
+
+void test_frozen_tree() {
+    avl_tree<int, int> empty;
+    frozen_avl_tree<int, int> frozen_empty = empty.freeze();
+    assert(frozen_empty.empty() && frozen_empty.begin() == frozen_empty.end());
+    assert(!frozen_empty.find(1) && frozen_empty.lower_bound(1) == frozen_empty.end());
+
+    // Sizes around powers of two give complete and partly filled last levels
+    std::mt19937 rng(20);
+    for (int size : {1, 2, 3, 7, 8, 9, 100, 1023, 1024, 5000}){
+        avl_tree<int, int> tree;
+        while (tree.get_size() < size) tree.insert(static_cast<int>(rng() % 20000) * 2, static_cast<int>(rng()));
+        frozen_avl_tree<int, int> frozen = tree.freeze();
+        assert(frozen.get_size() == size);
+
+        // Ordered iteration
+        assert(std::equal(frozen.begin(), frozen.end(), tree.begin(), tree.end(), [](const auto& element, const auto& node) {
+            return element.key == node.key && element.info == node.info;
+        }));
+
+        // Odd keys are never in the tree
+        for (int key = -1; key <= 40001; ++key){
+            assert(frozen.find(key) == tree.find(key));
+            auto expected = tree.lower_bound(key);
+            if (expected == tree.end()) assert(frozen.lower_bound(key) == frozen.end());
+            else assert(frozen.lower_bound(key)->key == expected->key && frozen.lower_bound(key)->info == expected->info);
+
+            auto expected_upper = tree.upper_bound(key);
+            if (expected_upper == tree.end()) assert(frozen.upper_bound(key) == frozen.end());
+            else assert(frozen.upper_bound(key)->key == expected_upper->key);
+        }
+    }
+
+    // Frozen copy does not follow the tree
+    avl_tree<std::string, int> words;
+    words.insert("b", 2);
+    words.insert("a", 1);
+    auto frozen_words = words.freeze();
+    words.insert("c", 3);
+    words.remove("a");
+    assert(frozen_words.get_size() == 2 && frozen_words["a"] == 1 && frozen_words.find(std::string_view("b")));
+    assert(throws<std::runtime_error>([&frozen_words] { frozen_words["c"]; }));
+
+    std::string visited;
+    frozen_words.traverse([&visited](const std::string& key, const int&) { visited += key; });
+    assert(visited == "ab");
+
+    cout << "Frozen tree tests passed!" << endl;
+}
+
+template <typename Key>
+void check_kary_tree(const std::vector<Key>& keys, const std::vector<Key>& probes){
+    avl_tree<Key, int> tree;
+    for (std::size_t i = 0; i < keys.size(); ++i) tree.insert(keys[i], static_cast<int>(i));
+    frozen_kary_tree<Key, int> frozen = tree.template freeze<frozen_kary_tree<Key, int>>();
+    assert(frozen.get_size() == tree.get_size());
+
+    assert(std::equal(frozen.begin(), frozen.end(), tree.begin(), tree.end(), [](const auto& element, const auto& node) {
+        return element.key == node.key && element.info == node.info;
+    }));
+
+    for (Key probe : probes){
+        assert(frozen.find(probe) == tree.find(probe));
+        if (tree.find(probe)) assert(frozen[probe] == tree[probe]);
+
+        auto expected = tree.lower_bound(probe);
+        if (expected == tree.end()) assert(frozen.lower_bound(probe) == frozen.end());
+        else assert(frozen.lower_bound(probe)->key == expected->key);
+
+        auto expected_upper = tree.upper_bound(probe);
+        if (expected_upper == tree.end()) assert(frozen.upper_bound(probe) == frozen.end());
+        else assert(frozen.upper_bound(probe)->key == expected_upper->key);
+    }
+}
+
+template <typename Key>
+void check_kary_sizes(){
+    // Sizes around one block, one index block and two index layers of 32-bit keys
+    const Key lowest = std::numeric_limits<Key>::lowest(), highest = std::numeric_limits<Key>::max();
+    std::mt19937 rng(21);
+    for (int size : {0, 1, 15, 16, 17, 271, 272, 273, 4623, 4624, 4625, 20000}){
+        std::vector<Key> keys, probes = {lowest, highest};
+        for (int i = 0; i < size; ++i) keys.push_back(static_cast<Key>(rng() % 100000) * 2);
+        for (int i = 0; i < 3000; ++i) probes.push_back(static_cast<Key>(rng() % 200003));
+        check_kary_tree(keys, probes);
+
+        // Extreme keys next to the padding value
+        keys.push_back(lowest);
+        keys.push_back(highest);
+        check_kary_tree(keys, probes);
+    }
+}
+
+void test_kary_tree() {
+    check_kary_sizes<int>();
+    check_kary_sizes<long long>();
+    check_kary_sizes<unsigned>();
+    check_kary_sizes<double>();
+
+    avl_tree<int, std::string> tree;
+    tree.insert(2, "two");
+    auto frozen = tree.freeze<frozen_kary_tree<int, std::string>>();
+    assert(frozen[2] == "two" && frozen.find(2) && !frozen.find(1));
+    assert(throws<std::runtime_error>([&frozen] { frozen[3]; }));
+
+    cout << "K-ary tree tests passed (" << frozen_kary_tree<int, int>::search_name() << ")!" << endl;
+}
+
+void test_find_batch() {
+    avl_tree<int, int> tree;
+    std::mt19937 rng(22);
+    for (int i = 0; i < 5000; ++i) tree.insert(static_cast<int>(rng() % 20000), i);
+
+    // Counts that are not a multiple of the group size
+    for (std::size_t count : {0, 1, 15, 16, 17, 1000}){
+        std::vector<int> keys(count);
+        for (int& key : keys) key = static_cast<int>(rng() % 20000);
+        int unset = 0;
+        std::vector<int*> results(count, &unset);
+        tree.find_batch(keys.data(), count, results.data());
+        for (std::size_t i = 0; i < count; ++i){
+            if (tree.find(keys[i])) assert(results[i] != nullptr && *results[i] == tree[keys[i]]);
+            else assert(results[i] == nullptr);
+        }
+    }
+
+    // Results point into the tree
+    int keys[] = {-1, tree.begin()->key, 30000};
+    int *results[3];
+    tree.find_batch(keys, 3, results);
+    assert(results[0] == nullptr && results[2] == nullptr);
+    *results[1] = -5;
+    assert(tree.begin()->info == -5);
+
+    // Const trees give const info, string keys are searched by std::string_view
+    avl_tree<std::string, int, prefix_less> words;
+    words.insert("a-long-shared-prefix-one", 1);
+    words.insert("a-long-shared-prefix-two", 2);
+    words.insert("b", 3);
+    const avl_tree<std::string, int, prefix_less>& constant = words;
+    std::string_view probes[] = {"b", "a-long-shared-prefix-two", "a-long-shared-prefix-three", ""};
+    const int *found[4];
+    constant.find_batch(probes, 4, found);
+    assert(*found[0] == 3 && *found[1] == 2 && found[2] == nullptr && found[3] == nullptr);
+
+    avl_tree<int, int> empty;
+    empty.find_batch(keys, 3, results);
+    assert(results[0] == nullptr && results[1] == nullptr && results[2] == nullptr);
+
+    cout << "Batched find tests passed!" << endl;
+}
+
+void test_insert_sorted_batch() {
+    avl_tree<int, int> tree;
+    std::map<int, int> expected;
+    std::mt19937 rng(23);
+
+    // Batches of every size into a growing tree, sums decide info of keys present in both
+    for (int round = 0; round < 40; ++round){
+        std::map<int, int> batch;
+        int batch_size = (round % 4 == 0) ? 1 : static_cast<int>(rng() % 3000);
+        for (int i = 0; i < batch_size; ++i) batch[static_cast<int>(rng() % 50000)] = static_cast<int>(rng() % 100);
+
+        tree.insert_sorted_batch(batch.begin(), batch.end(), [](int& info, const int& batch_info) { info += batch_info; });
+        for (const auto& element : batch) expected[element.first] += element.second;
+
+        assert(tree.get_size() == static_cast<int>(expected.size()));
+        assert(tree.is_balanced());
+    }
+    assert(std::equal(tree.begin(), tree.end(), expected.begin(), [](const auto& element, const auto& pair) {
+        return element.key == pair.first && element.info == pair.second;
+    }));
+
+    // Runs past the largest key and inside one gap are linked in next to the previous key
+    std::vector<std::pair<int, int>> runs;
+    for (int key = 60000; key < 65000; ++key) runs.emplace_back(key, 1);
+    tree.insert_sorted_batch(runs.begin(), runs.end());
+    runs.clear();
+    for (int key = 65001; key < 70000; key += 2) runs.emplace_back(key, 1);
+    tree.insert_sorted_batch(runs.begin(), runs.end());
+    assert(tree.is_balanced() && tree.get_size() == static_cast<int>(expected.size()) + 7500);
+    for (const auto& element : runs) expected[element.first] = 1;
+    for (int key = 60000; key < 65000; ++key) expected[key] = 1;
+    assert(std::equal(tree.begin(), tree.end(), expected.begin(), [](const auto& element, const auto& pair) {
+        return element.key == pair.first && element.info == pair.second;
+    }));
+
+    // Elements of another tree are accepted, by default they replace info
+    avl_tree<int, int> other;
+    other.insert(tree.begin()->key, -1);
+    other.insert(-5, 5);
+    tree.insert_sorted_batch(other.begin(), other.end());
+    assert(tree[-5] == 5 && tree.begin()->info == 5 && std::next(tree.begin())->info == -1);
+
+    std::vector<std::pair<int, int>> none;
+    tree.insert_sorted_batch(none.begin(), none.end());
+    assert(tree.get_size() == static_cast<int>(expected.size()) + 1);
+
+    // Unsorted batch leaves the tree as it was
+    std::vector<std::pair<int, int>> unsorted = {{1, 1}, {3, 3}, {3, 4}};
+    assert(throws<std::invalid_argument>([&] { tree.insert_sorted_batch(unsorted.begin(), unsorted.end()); }));
+    assert(tree.get_size() == static_cast<int>(expected.size()) + 1);
+
+    // Subtree sizes of ranked trees stay right
+    ranked_avl_tree<int, int> ranked;
+    std::vector<std::pair<int, int>> odds, evens;
+    for (int key = 0; key < 2000; ++key) (key % 2 ? odds : evens).emplace_back(key, key);
+    ranked.insert_sorted_batch(evens.begin(), evens.end());
+    ranked.insert_sorted_batch(odds.begin(), odds.end());
+    assert(ranked.get_size() == 2000 && ranked.is_balanced());
+    assert(ranked.select(1234)->key == 1234 && ranked.rank(777) == 777);
+
+    cout << "Sorted batch insert tests passed!" << endl;
+}
+
+// Comparator that counts its calls
+struct counting_less {
+    static long long calls;
+
+    bool operator()(int a, int b) const {
+        calls++;
+        return a < b;
+    }
+};
+
+long long counting_less::calls = 0;
+
+// True if tree holds keys 0 to count - 1, each with info equal to its key
+bool holds_keys_up_to(const avl_tree<int, int>& tree, int count){
+    int expected_key = 0;
+    for (const auto& element : tree){
+        if (element.key != expected_key || element.info != expected_key) return false;
+        expected_key++;
+    }
+    return expected_key == count;
+}
+
+void test_hinted_insert_find() {
+    // Increasing keys with end() and with the previous element as hint, decreasing keys with the next element
+    avl_tree<int, int> at_end, after, before;
+    auto after_hint = after.end(), before_hint = before.end();
+    for (int key = 0; key < 3000; ++key){
+        at_end.insert(at_end.end(), key, key);
+        after_hint = after.insert(after_hint, key, key);
+        before_hint = before.insert(before_hint, 2999 - key, 2999 - key);
+    }
+    assert(holds_keys_up_to(at_end, 3000) && holds_keys_up_to(after, 3000) && holds_keys_up_to(before, 3000));
+    assert(at_end.is_balanced() && after.is_balanced() && before.is_balanced());
+
+    // Any hint gives the same result as insert without one, existing keys get the new info
+    avl_tree<int, int> tree;
+    std::map<int, int> expected;
+    std::mt19937 rng(24);
+    auto previous = tree.end();
+    for (int i = 0; i < 20000; ++i){
+        int key = static_cast<int>(rng() % 5000);
+        int choice = static_cast<int>(rng() % 4);
+        auto hint = (tree.empty() || choice == 0) ? tree.end() : (choice == 1) ? previous : tree.lower_bound(static_cast<int>(rng() % 5000));
+        previous = tree.insert(hint, key, i);
+        expected[key] = i;
+        assert(previous->key == key && previous->info == i);
+    }
+    assert(tree.is_balanced() && tree.get_size() == static_cast<int>(expected.size()));
+    assert(std::equal(tree.begin(), tree.end(), expected.begin(), [](const auto& element, const auto& pair) {
+        return element.key == pair.first && element.info == pair.second;
+    }));
+
+    // find_from finds the same elements as find from any hint
+    const avl_tree<int, int>& constant = tree;
+    std::vector<int> misses;
+    for (int i = 0; i < 20000; ++i){
+        int key = static_cast<int>(rng() % 5200);
+        auto hint = (rng() % 8 == 0) ? constant.end() : constant.lower_bound(static_cast<int>(rng() % 5000));
+        if (constant.find_from(hint, key) != (tree.find(key) ? constant.lower_bound(key) : constant.end())) misses.push_back(key);
+    }
+    assert(misses.empty());
+    tree.find_from(tree.begin(), tree.begin()->key)->info = -1;
+    assert(tree.begin()->info == -1);
+
+    // Inserting past the last or before the first element compares the key with the hint or the end it stands for only,
+    // the neighbour on the other side comes from the ends the tree keeps, nothing walks down or up the tree
+    avl_tree<int, int, counting_less> ends;
+    for (int key = 0; key < 4096; ++key){
+        counting_less::calls = 0;
+        ends.insert(ends.end(), key * 3, key);
+        assert(counting_less::calls <= 2);
+    }
+    auto last = --ends.end();
+    for (int key = 4096; key < 8192; ++key){
+        counting_less::calls = 0;
+        last = ends.insert(last, key * 3, key);
+        assert(counting_less::calls <= 2);
+    }
+    auto first = ends.begin();
+    for (int key = 1; key <= 4096; ++key){
+        counting_less::calls = 0;
+        first = ends.insert(first, -key * 3, key);
+        assert(counting_less::calls <= 2);
+    }
+    assert(ends.is_balanced() && ends.get_size() == 3 * 4096);
+    assert(ends.begin()->key == -3 * 4096 && (--ends.end())->key == 3 * 8191);
+
+    // Ends follow removals and the operations that rebuild the tree
+    ends.remove(-3 * 4096);
+    ends.remove(3 * 8191);
+    assert(ends.begin()->key == -3 * 4095 && (--ends.end())->key == 3 * 8190);
+    auto upper = ends.split(0);
+    assert((--ends.end())->key == -3 && upper.begin()->key == 0 && (--upper.end())->key == 3 * 8190);
+    ends.join(upper);
+    assert(upper.empty() && upper.begin() == upper.end() && (--ends.end())->key == 3 * 8190);
+    ends.clear();
+    ends.insert(ends.end(), 5, 5);
+    assert(ends.begin()->key == 5 && (--ends.end())->key == 5);
+
+    // Subtree sizes of ranked trees stay right
+    ranked_avl_tree<int, int> ranked;
+    auto hint = ranked.end();
+    for (int key = 0; key < 1000; ++key) hint = ranked.insert(hint, key * 2, key);
+    for (int key = 999; key >= 0; --key) hint = ranked.insert(hint, key * 2 + 1, key);
+    assert(ranked.is_balanced() && ranked.get_size() == 2000);
+    assert(ranked.select(777)->key == 777 && ranked.rank(1500) == 1500);
+
+    cout << "Hinted insert and find tests passed!" << endl;
+}
+
+template <typename Tree>
+bool same_elements(const Tree& tree, const std::map<int, int>& expected){
+    if (tree.get_size() != static_cast<int>(expected.size())) return false;
+
+    auto it = expected.begin();
+    bool same = true;
+    tree.traverse([&](const int& key, const int& info) {
+        same = same && it != expected.end() && key == it->first && info == it->second;
+        ++it;
+    });
+    return same;
+}
+
+void test_persistent_tree() {
+    // Every version keeps its elements while later versions are made from it
+    std::vector<persistent_avl_tree<int, int>> versions(1);
+    std::vector<std::map<int, int>> expected(1);
+    std::mt19937 rng(25);
+    for (int i = 0; i < 3000; ++i){
+        int key = static_cast<int>(rng() % 500);
+        const persistent_avl_tree<int, int>& last = versions.back();
+        std::map<int, int> elements = expected.back();
+        if (rng() % 3 == 0){
+            versions.push_back(last.remove(key));
+            elements.erase(key);
+        }
+        else{
+            versions.push_back(last.insert(key, i));
+            elements[key] = i;
+        }
+        expected.push_back(std::move(elements));
+    }
+    for (std::size_t v = 0; v < versions.size(); v += 7){
+        assert(same_elements(versions[v], expected[v]));
+        assert(versions[v].is_balanced());
+    }
+
+    // Old versions survive the newer ones, removing a missing key gives the same version
+    persistent_avl_tree<int, int> old = versions[1500];
+    versions.erase(versions.begin() + 1000, versions.end());
+    assert(same_elements(old, expected[1500]) && same_elements(versions.back(), expected[999]));
+    assert(old.remove(100000).get_size() == old.get_size());
+
+    // Versions that are moved from are updated in place
+    persistent_avl_tree<int, int> moved = old;
+    for (int key = 0; key < 1000; ++key) moved = std::move(moved).insert(key, -key);
+    for (int key = 0; key < 1000; key += 2) moved = std::move(moved).remove(key);
+    assert(moved.get_size() == 500 && moved[1] == -1 && !moved.find(2) && moved.is_balanced());
+    assert(same_elements(old, expected[1500]));
+
+    assert(throws<std::runtime_error>([&moved] { moved[2]; }));
+
+    // Readers on other threads keep their snapshots while the writer goes on
+    persistent_avl_tree<int, int> live;
+    for (int key = 0; key < 2000; ++key) live = std::move(live).insert(key, 1);
+    std::vector<std::thread> readers;
+    for (int r = 0; r < 4; ++r){
+        persistent_avl_tree<int, int> snapshot = live;
+        long long expected_sum = 0;
+        snapshot.traverse([&expected_sum](const int&, const int& info) { expected_sum += info; });
+        readers.emplace_back([snapshot, expected_sum]() {
+            for (int rep = 0; rep < 20; ++rep){
+                long long sum = 0;
+                snapshot.traverse([&sum](const int&, const int& info) { sum += info; });
+                assert(sum == expected_sum && snapshot.is_balanced());
+            }
+        });
+        for (int key = 0; key < 2000; key += 5) live = live.insert(key, 2 + r).remove(key + 1);
+    }
+    for (std::thread& reader : readers) reader.join();
+    assert(live.is_balanced() && live[0] == 5);
+
+    persistent_avl_tree<std::string, int> words;
+    auto with_word = words.insert(std::string("word"), 1);
+    assert(words.empty() && with_word.find(std::string_view("word")));
+
+    cout << "Persistent tree tests passed!" << endl;
+}
+
+template <template <typename> class Allocator>
+int benchmark_count_words(const std::string& label){
     for (int rep = 0; rep < 5; ++rep)
     {
         std::ifstream is("beagle_voyage.txt");
@@ -349,20 +1686,628 @@ int test_count_words(){
         }
         auto start_time = std::chrono::high_resolution_clock::now();
         std::string word;
-        avl_tree<std::string, int> wc; // counting word occurrences in the stream
+        avl_tree<std::string, int, std::less<>, Allocator> wc; // counting word occurrences in the stream
         while (is >> word)
         {
             wc[word]++;
         }
+        auto count_time = std::chrono::high_resolution_clock::now();
+        wc.clear();
+        auto end_time = std::chrono::high_resolution_clock::now();
+        std::cout << label << " ellapsed time: " << (count_time - start_time)/std::chrono::milliseconds(1)
+                  << " ms, clear: " << (end_time - count_time)/std::chrono::microseconds(1) << " us.\n";
+    }
+    return 0;
+}
+
+int test_count_words(){
+    if (benchmark_count_words<heap_allocator>("heap")) return 1;
+    return benchmark_count_words<pool_allocator>("pool");
+}
+
+int test_tree_throughput(){
+    std::ifstream is("beagle_voyage.txt");
+    if (!is)
+    {
+        std::cout << "Error opening input file.\n";
+        return 1;
+    }
+    std::vector<std::string> words;
+    std::string word;
+    while (is >> word)
+    {
+        words.push_back(word);
+    }
+
+    auto mops = [&words](std::chrono::high_resolution_clock::duration time) {
+        return words.size() / (time / std::chrono::nanoseconds(1) / 1000.0);
+    };
+
+    for (int rep = 0; rep < 5; ++rep)
+    {
+        avl_tree<std::string, int> wc;
+
+        auto start_time = std::chrono::high_resolution_clock::now();
+        for (const std::string& w : words) wc.insert(w, 1);
+        auto insert_time = std::chrono::high_resolution_clock::now();
+        std::size_t found = 0;
+        for (const std::string& w : words) found += wc.find(w);
+        auto find_time = std::chrono::high_resolution_clock::now();
+        for (const std::string& w : words) wc.remove(w);
+        auto remove_time = std::chrono::high_resolution_clock::now();
+
+        assert(found == words.size());
+        assert(wc.empty());
+        std::cout << std::fixed << std::setprecision(2)
+                  << "insert: " << mops(insert_time - start_time) << " Mops/s, "
+                  << "find: " << mops(find_time - insert_time) << " Mops/s (" << found << " hits), "
+                  << "remove: " << mops(remove_time - find_time) << " Mops/s.\n";
+    }
+    return 0;
+}
+
+// String key that counts how many times it was compared
+struct counted_string {
+    std::string value;
+    static long long comparisons;
+
+    int compare(const counted_string& other) const {
+        comparisons++;
+        return value.compare(other.value);
+    }
+
+    bool operator<(const counted_string& other) const {
+        comparisons++;
+        return value < other.value;
+    }
+};
+
+long long counted_string::comparisons = 0;
+
+// Exposes only operator<, so the tree has to fall back to two calls per level
+struct two_way_less {
+    bool operator()(const counted_string& a, const counted_string& b) const { return a < b; }
+};
+
+template <typename Compare>
+void count_comparisons(const std::string& label, const std::vector<counted_string>& words) {
+    avl_tree<counted_string, int, Compare> wc;
+
+    counted_string::comparisons = 0;
+    for (const counted_string& w : words) wc.upsert(w, [](int& count) { count++; });
+    long long upsert_comparisons = counted_string::comparisons;
+
+    counted_string::comparisons = 0;
+    for (const counted_string& w : words) wc.find(w);
+    long long find_comparisons = counted_string::comparisons;
+
+    counted_string::comparisons = 0;
+    for (const counted_string& w : words) wc.remove(w);
+    long long remove_comparisons = counted_string::comparisons;
+
+    std::cout << std::fixed << std::setprecision(2) << label
+              << " comparisons per upsert: " << upsert_comparisons / double(words.size())
+              << ", find: " << find_comparisons / double(words.size())
+              << ", remove: " << remove_comparisons / double(words.size()) << ".\n";
+}
+
+int test_comparison_count(){
+    std::ifstream is("beagle_voyage.txt");
+    if (!is)
+    {
+        std::cout << "Error opening input file.\n";
+        return 1;
+    }
+    std::vector<counted_string> words;
+    std::string word;
+    while (is >> word)
+    {
+        words.push_back({word});
+    }
+
+    count_comparisons<two_way_less>("two-way", words);
+    count_comparisons<std::less<>>("three-way", words);
+    return 0;
+}
+
+int test_bulk_build(){
+    std::vector<std::pair<int, int>> sorted;
+    for (int key = 0; key < 1000000; ++key) {
+        sorted.emplace_back(key, key);
+    }
+
+    auto start_time = std::chrono::high_resolution_clock::now();
+    avl_tree<int, int> inserted;
+    for (const auto& element : sorted) inserted.insert(element.first, element.second);
+    auto insert_time = std::chrono::high_resolution_clock::now();
+    auto built = avl_tree<int, int>::build_from_sorted(sorted.begin(), sorted.end());
+    auto build_time = std::chrono::high_resolution_clock::now();
+
+    assert(built.get_size() == inserted.get_size());
+    std::cout << "1M sorted keys, inserts: " << (insert_time - start_time)/std::chrono::milliseconds(1)
+              << " ms, build_from_sorted: " << (build_time - insert_time)/std::chrono::milliseconds(1) << " ms.\n";
+    return 0;
+}
+
+int test_parallel_scaling(){
+    std::vector<std::pair<int, int>> evens, thirds;
+    for (int key = 0; key < 4000000; key += 2) evens.emplace_back(key, 1);
+    for (int key = 0; key < 6000000; key += 3) thirds.emplace_back(key, 1);
+    auto a = avl_tree<int, int>::build_from_sorted(evens.begin(), evens.end());
+    auto b = avl_tree<int, int>::build_from_sorted(thirds.begin(), thirds.end());
+
+    unsigned max_threads = std::max(2u, std::thread::hardware_concurrency());
+    for (unsigned threads = 1; threads <= max_threads; threads *= 2)
+    {
+        task_pool pool(threads);
+
+        auto start_time = std::chrono::high_resolution_clock::now();
+        auto sum = avl_tree<int, int>::parallel_union(a, b, pool);
+        auto union_time = std::chrono::high_resolution_clock::now();
+        auto difference = avl_tree<int, int>::parallel_difference(a, b, pool);
+        auto difference_time = std::chrono::high_resolution_clock::now();
+        auto common = avl_tree<int, int>::parallel_intersection(a, b, pool);
+        auto intersection_time = std::chrono::high_resolution_clock::now();
+
+        assert(sum.get_size() == 3333333);
+        std::cout << "2M and 2M keys, " << threads << " threads, union: "
+                  << (union_time - start_time)/std::chrono::milliseconds(1) << " ms, difference: "
+                  << (difference_time - union_time)/std::chrono::milliseconds(1) << " ms, intersection: "
+                  << (intersection_time - difference_time)/std::chrono::milliseconds(1) << " ms.\n";
+    }
+    return 0;
+}
+
+// Writes copies of the book to path, synthetic corpus for benchmarks
+bool make_corpus(const char* path, int copies){
+    std::ifstream is("beagle_voyage.txt", std::ios::binary);
+    if (!is) return false;
+
+    std::string text((std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
+    std::ofstream os(path, std::ios::binary);
+    for (int copy = 0; copy < copies; ++copy) os << text << '\n';
+    return true;
+}
+
+int benchmark_mapped_count_words(const char* path, const std::string& label){
+    for (int rep = 0; rep < 3; ++rep)
+    {
+        auto start_time = std::chrono::high_resolution_clock::now();
+        std::ifstream is(path);
+        auto streamed = count_words(is);
+        auto stream_time = std::chrono::high_resolution_clock::now();
+        auto mapped = count_words_file(path);
+        auto end_time = std::chrono::high_resolution_clock::now();
+
+        assert(same_counts(streamed, mapped));
+        std::cout << label << ", istream: " << (stream_time - start_time)/std::chrono::milliseconds(1)
+                  << " ms, mapped: " << (end_time - stream_time)/std::chrono::milliseconds(1) << " ms.\n";
+    }
+    return 0;
+}
+
+int test_mapped_count_words_speed(){
+    benchmark_mapped_count_words("beagle_voyage.txt", "1 MB book");
+
+    const char* path = "beagle_voyage_x16.txt";
+    if (!make_corpus(path, 16))
+    {
+        std::cout << "Error opening input file.\n";
+        return 1;
+    }
+    benchmark_mapped_count_words(path, "18 MB corpus");
+    std::remove(path);
+    return 0;
+}
+
+int test_word_scan_speed(){
+    const char* path = "beagle_voyage_x16.txt";
+    if (!make_corpus(path, 16))
+    {
+        std::cout << "Error opening input file.\n";
+        return 1;
+    }
+
+    {
+        mapped_file file(path);
+        auto measure = [&file](const std::string& label, avl_detail::whitespace_masks_fn masks_of){
+            std::size_t tokens = 0, bytes = 0;
+            auto start_time = std::chrono::high_resolution_clock::now();
+            for (int rep = 0; rep < 5; ++rep)
+            {
+                for_each_word(file.view(), [&](std::string_view word) { tokens++; bytes += word.size(); }, masks_of);
+            }
+            auto end_time = std::chrono::high_resolution_clock::now();
+            double seconds = std::chrono::duration<double>(end_time - start_time).count();
+            std::cout << "18 MB corpus, " << label << " scan: " << tokens / seconds / 1e6 << " M tokens/s, "
+                      << 5 * file.size() / seconds / 1e9 << " GB/s (" << bytes << " word bytes).\n";
+        };
+
+        measure("scalar", nullptr);
+#if WORD_SCAN_X86
+        measure("sse2", avl_detail::whitespace_masks_sse2);
+        if (__builtin_cpu_supports("avx2")) measure("avx2", avl_detail::whitespace_masks_avx2);
+#endif
+    }
+
+    std::remove(path);
+    return 0;
+}
+
+template <typename Tree>
+void benchmark_word_count_tree(const mapped_file& file, const std::string& label){
+    for (int rep = 0; rep < 3; ++rep)
+    {
+        auto start_time = std::chrono::high_resolution_clock::now();
+        Tree counted = count_words<Tree>(file.view());
+        auto count_time = std::chrono::high_resolution_clock::now();
+        counted.clear();
         auto end_time = std::chrono::high_resolution_clock::now();
-        auto time = end_time - start_time;
-        std::cout << "Ellapsed time: " << time/std::chrono::milliseconds(1)
-                  << " ms.\n";
+        std::cout << "18 MB corpus, " << label << ": " << (count_time - start_time)/std::chrono::milliseconds(1)
+                  << " ms, clear: " << (end_time - count_time)/std::chrono::microseconds(1) << " us.\n";
+    }
+}
+
+// Many distinct keys longer than the small string buffer, one key allocation per std::string node
+template <typename Tree>
+void benchmark_unique_keys(const std::vector<std::string>& keys, const std::string& label){
+    auto start_time = std::chrono::high_resolution_clock::now();
+    Tree tree;
+    for (const std::string& key : keys) tree.upsert(std::string_view(key), [](int& count) { count++; });
+    auto insert_time = std::chrono::high_resolution_clock::now();
+    int hits = 0;
+    for (const std::string& key : keys) hits += tree.find(std::string_view(key));
+    auto find_time = std::chrono::high_resolution_clock::now();
+    tree.clear();
+    auto end_time = std::chrono::high_resolution_clock::now();
+    std::cout << "500k distinct keys, " << label << ", insert: " << (insert_time - start_time)/std::chrono::milliseconds(1)
+              << " ms, find: " << (find_time - insert_time)/std::chrono::milliseconds(1)
+              << " ms, clear: " << (end_time - find_time)/std::chrono::microseconds(1) << " us, hits: " << hits << ".\n";
+}
+
+int test_word_count_tree_speed(){
+    std::vector<std::string> keys;
+    std::mt19937 rng(17);
+    for (int i = 0; i < 500000; ++i) keys.push_back("distinct-key-" + std::to_string(rng()) + "-" + std::to_string(i));
+    benchmark_unique_keys<avl_tree<std::string, int>>(keys, "std::string keys");
+    benchmark_unique_keys<avl_tree<std::string, int, std::less<>, pool_allocator>>(keys, "std::string keys, pool");
+    benchmark_unique_keys<word_count_tree>(keys, "arena keys");
+
+
+    const char* path = "beagle_voyage_x16.txt";
+    if (!make_corpus(path, 16))
+    {
+        std::cout << "Error opening input file.\n";
+        return 1;
     }
+
+    {
+        mapped_file file(path);
+        benchmark_word_count_tree<avl_tree<std::string, int>>(file, "std::string keys");
+        benchmark_word_count_tree<avl_tree<std::string, int, std::less<>, pool_allocator>>(file, "std::string keys, pool");
+        benchmark_word_count_tree<word_count_tree>(file, "arena keys");
+    }
+
+    std::remove(path);
     return 0;
 }
 
+// Last level cache misses of the calling thread from perf_event_open, valid() is false where counters are unavailable
+class cache_miss_counter{
+private:
+    int fd = -1;
+
+public:
+    cache_miss_counter(){
+#if defined(__linux__)
+        perf_event_attr attr{};
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+#endif
+    }
+
+    cache_miss_counter(const cache_miss_counter&) = delete;
+    cache_miss_counter& operator=(const cache_miss_counter&) = delete;
 
+    ~cache_miss_counter(){
+#if defined(__linux__)
+        if (fd >= 0) close(fd);
+#endif
+    }
+
+    bool valid() const { return fd >= 0; }
+
+    void start(){
+#if defined(__linux__)
+        if (fd >= 0){
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+
+    long long stop(){
+        long long misses = 0;
+#if defined(__linux__)
+        if (fd >= 0){
+            ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+            if (read(fd, &misses, sizeof(misses)) != sizeof(misses)) misses = 0;
+        }
+#endif
+        return misses;
+    }
+};
+
+template <typename Tree>
+void benchmark_prefix_lookups(const std::vector<std::string>& keys, const std::vector<std::string>& probes, const std::string& label){
+    Tree tree;
+    for (const std::string& key : keys) tree.insert(key, 1);
+
+    cache_miss_counter counter;
+    int hits = 0;
+    counter.start();
+    auto start_time = std::chrono::high_resolution_clock::now();
+    for (int rep = 0; rep < 3; ++rep)
+    {
+        for (const std::string& probe : probes) hits += tree.find(std::string_view(probe));
+    }
+    auto end_time = std::chrono::high_resolution_clock::now();
+    long long misses = counter.stop();
+
+    std::cout << "500k keys, " << label << ", 1.5M finds: " << (end_time - start_time)/std::chrono::milliseconds(1) << " ms, ";
+    if (counter.valid()) std::cout << "cache misses: " << misses;
+    else std::cout << "cache misses: counters unavailable";
+    std::cout << ", hits: " << hits << ".\n";
+}
+
+int test_prefix_compare_speed(){
+    // Keys longer than the small string buffer that differ early, so prefixes decide nearly every comparison
+    std::vector<std::string> keys, probes;
+    std::mt19937 rng(18);
+    for (int i = 0; i < 500000; ++i) keys.push_back(std::to_string(rng()) + "-a-key-kept-on-the-heap-" + std::to_string(i));
+    probes = keys;
+    std::shuffle(probes.begin(), probes.end(), rng);
+
+    benchmark_prefix_lookups<avl_tree<std::string, int>>(keys, probes, "std::less<>");
+    benchmark_prefix_lookups<avl_tree<std::string, int, prefix_less>>(keys, probes, "prefix_less");
+    return 0;
+}
+
+// Bytes allocated on the heap and not freed yet, 0 where the C library does not tell
+std::size_t heap_bytes(){
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+#else
+    return 0;
+#endif
+}
+
+template <typename Tree>
+void benchmark_int_tree(const std::vector<int>& keys, const std::string& label){
+    std::size_t before = heap_bytes();
+    auto start_time = std::chrono::high_resolution_clock::now();
+    Tree tree;
+    for (int key : keys) tree.insert(key, key);
+    auto insert_time = std::chrono::high_resolution_clock::now();
+    int hits = 0;
+    for (int key : keys) hits += tree.find(key);
+    auto find_time = std::chrono::high_resolution_clock::now();
+    std::size_t after = heap_bytes();
+
+    std::cout << "2M random int keys, " << label << ", insert: " << (insert_time - start_time)/std::chrono::milliseconds(1)
+              << " ms, find: " << (find_time - insert_time)/std::chrono::milliseconds(1) << " ms, ";
+    if (after > before) std::cout << "memory: " << (after - before) / tree.get_size() << " bytes per element";
+    else std::cout << "memory: unavailable";
+    std::cout << ", hits: " << hits << ".\n";
+}
+
+int test_compact_tree_speed(){
+    std::vector<int> keys(2000000);
+    std::mt19937 rng(19);
+    for (int& key : keys) key = static_cast<int>(rng());
+
+    benchmark_int_tree<avl_tree<int, int>>(keys, "avl_tree");
+    benchmark_int_tree<avl_tree<int, int, std::less<>, pool_allocator>>(keys, "avl_tree, pool");
+    benchmark_int_tree<compact_avl_tree<int, int>>(keys, "compact_avl_tree");
+    return 0;
+}
+
+template <typename Tree>
+void benchmark_lookup_latency(const Tree& tree, const std::vector<int>& probes, const std::string& label){
+    int hits = 0;
+    auto start_time = std::chrono::high_resolution_clock::now();
+    for (int probe : probes) hits += tree.find(probe);
+    auto end_time = std::chrono::high_resolution_clock::now();
+
+    std::cout << "2M int keys, " << label << ", " << probes.size() / 1000000 << "M finds: "
+              << (end_time - start_time)/std::chrono::nanoseconds(1) / static_cast<long long>(probes.size()) << " ns per find, hits: " << hits << ".\n";
+}
+
+int test_frozen_lookup_speed(){
+    std::vector<int> keys(2000000);
+    std::mt19937 rng(20);
+    for (int& key : keys) key = static_cast<int>(rng());
+
+    avl_tree<int, int> tree;
+    for (int key : keys) tree.insert(key, key);
+    frozen_avl_tree<int, int> frozen = tree.freeze();
+
+    // Random probes, half of them hits, so every find is a walk from the root with cold lower levels
+    std::vector<int> probes(4000000);
+    for (std::size_t i = 0; i < probes.size(); ++i) probes[i] = (i % 2 == 0) ? keys[rng() % keys.size()] : static_cast<int>(rng());
+
+    benchmark_lookup_latency(tree, probes, "avl_tree");
+    benchmark_lookup_latency(frozen, probes, "frozen_avl_tree");
+    benchmark_lookup_latency(tree.freeze<frozen_kary_tree<int, int>>(), probes,
+                             std::string("frozen_kary_tree, ") + frozen_kary_tree<int, int>::search_name());
+    return 0;
+}
+
+int test_find_batch_speed(){
+    std::vector<int> keys(2000000);
+    std::mt19937 rng(22);
+    for (int& key : keys) key = static_cast<int>(rng());
+
+    avl_tree<int, int> tree;
+    for (int key : keys) tree.insert(key, 1);
+
+    std::vector<int> probes(4000000);
+    for (std::size_t i = 0; i < probes.size(); ++i) probes[i] = (i % 2 == 0) ? keys[rng() % keys.size()] : static_cast<int>(rng());
+    std::vector<int*> results(probes.size());
+
+    long long hits = 0;
+    auto start_time = std::chrono::high_resolution_clock::now();
+    for (int probe : probes) hits += tree.find(probe);
+    auto end_time = std::chrono::high_resolution_clock::now();
+    std::cout << "2M int keys, looped find, 4M keys: " << (end_time - start_time)/std::chrono::milliseconds(1) << " ms, hits: " << hits << ".\n";
+
+    hits = 0;
+    start_time = std::chrono::high_resolution_clock::now();
+    tree.find_batch(probes.data(), probes.size(), results.data());
+    for (int* result : results) hits += result != nullptr;
+    end_time = std::chrono::high_resolution_clock::now();
+    std::cout << "2M int keys, find_batch, 4M keys: " << (end_time - start_time)/std::chrono::milliseconds(1) << " ms, hits: " << hits << ".\n";
+    return 0;
+}
+
+template <typename Batch>
+void benchmark_sorted_batch(const avl_tree<int, int>& base, const Batch& batch, const std::string& label){
+    avl_tree<int, int> inserted(base), batched(base);
+    auto start_time = std::chrono::high_resolution_clock::now();
+    for (const auto& element : batch) inserted.insert(element.first, element.second);
+    auto insert_time = std::chrono::high_resolution_clock::now();
+    batched.insert_sorted_batch(batch.begin(), batch.end());
+    auto batch_time = std::chrono::high_resolution_clock::now();
+
+    assert(batched.get_size() == inserted.get_size());
+    std::cout << "1M keys, " << batch.size() << " " << label << ", inserts: " << (insert_time - start_time)/std::chrono::milliseconds(1)
+              << " ms, insert_sorted_batch: " << (batch_time - insert_time)/std::chrono::milliseconds(1) << " ms.\n";
+}
+
+int test_sorted_batch_speed(){
+    std::mt19937 rng(23);
+    avl_tree<int, int> base;
+    while (base.get_size() < 1000000) base.insert(static_cast<int>(rng() % 1000000000), 1);
+
+    for (int batch_size : {1000, 100000, 1000000})
+    {
+        // Keys spread over the whole tree
+        std::map<int, int> spread;
+        while (static_cast<int>(spread.size()) < batch_size) spread.emplace(static_cast<int>(rng() % 1000000000), 1);
+        benchmark_sorted_batch(base, std::vector<std::pair<int, int>>(spread.begin(), spread.end()), "spread sorted keys");
+
+        // Consecutive keys past the largest one, like new timestamps
+        std::vector<std::pair<int, int>> appended;
+        for (int i = 0; i < batch_size; ++i) appended.emplace_back(1000000000 + i, 1);
+        benchmark_sorted_batch(base, appended, "appended sorted keys");
+    }
+    return 0;
+}
+
+int test_hinted_insert_speed(){
+    const int n = 1000000;
+
+    // Increasing keys, like timestamps
+    auto start_time = std::chrono::high_resolution_clock::now();
+    avl_tree<int, int> plain;
+    for (int key = 0; key < n; ++key) plain.insert(key, key);
+    auto plain_time = std::chrono::high_resolution_clock::now();
+    avl_tree<int, int> at_end;
+    for (int key = 0; key < n; ++key) at_end.insert(at_end.end(), key, key);
+    auto end_time = std::chrono::high_resolution_clock::now();
+    avl_tree<int, int> after;
+    auto hint = after.end();
+    for (int key = 0; key < n; ++key) hint = after.insert(hint, key, key);
+    auto after_time = std::chrono::high_resolution_clock::now();
+
+    std::cout << "1M increasing keys, insert: " << (plain_time - start_time)/std::chrono::milliseconds(1)
+              << " ms, insert at end(): " << (end_time - plain_time)/std::chrono::milliseconds(1)
+              << " ms, insert after previous: " << (after_time - end_time)/std::chrono::milliseconds(1) << " ms.\n";
+
+    // Sorted lookups, each one next to the previous
+    long long hits = 0;
+    start_time = std::chrono::high_resolution_clock::now();
+    for (int key = 0; key < n; ++key) hits += plain.find(key);
+    auto find_time = std::chrono::high_resolution_clock::now();
+    auto found = plain.cbegin();
+    for (int key = 0; key < n; ++key){
+        found = plain.find_from(found, key);
+        hits += found != plain.cend();
+    }
+    auto find_from_time = std::chrono::high_resolution_clock::now();
+
+    std::cout << "1M sorted lookups, find: " << (find_time - start_time)/std::chrono::milliseconds(1)
+              << " ms, find_from previous: " << (find_from_time - find_time)/std::chrono::milliseconds(1) << " ms, hits: " << hits << ".\n";
+    return 0;
+}
+
+int test_persistent_snapshot_speed(){
+    std::vector<int> keys(1000000);
+    std::mt19937 rng(25);
+    for (int& key : keys) key = static_cast<int>(rng());
+
+    avl_tree<int, int> tree;
+    persistent_avl_tree<int, int> persistent;
+    for (int key : keys){
+        tree.insert(key, 1);
+        persistent = std::move(persistent).insert(key, 1);
+    }
+
+    // A snapshot before every 10000 updates
+    auto start_time = std::chrono::high_resolution_clock::now();
+    for (int round = 0; round < 10; ++round)
+    {
+        avl_tree<int, int> snapshot(tree);
+        for (int i = 0; i < 10000; ++i) tree.insert(static_cast<int>(rng()), 2);
+    }
+    auto copy_time = std::chrono::high_resolution_clock::now();
+    for (int round = 0; round < 10; ++round)
+    {
+        persistent_avl_tree<int, int> snapshot(persistent);
+        for (int i = 0; i < 10000; ++i) persistent = std::move(persistent).insert(static_cast<int>(rng()), 2);
+    }
+    auto persistent_time = std::chrono::high_resolution_clock::now();
+
+    std::cout << "1M keys, 10 snapshots and 100k inserts, avl_tree copies: " << (copy_time - start_time)/std::chrono::milliseconds(1)
+              << " ms, persistent_avl_tree: " << (persistent_time - copy_time)/std::chrono::milliseconds(1) << " ms.\n";
+    return 0;
+}
+
+int test_count_words_scaling(){
+    const char* path = "beagle_voyage_x16.txt";
+    if (!make_corpus(path, 16))
+    {
+        std::cout << "Error opening input file.\n";
+        return 1;
+    }
+
+    auto start_time = std::chrono::high_resolution_clock::now();
+    std::ifstream is(path);
+    auto expected = count_words(is);
+    auto end_time = std::chrono::high_resolution_clock::now();
+    std::cout << "18 MB corpus, count_words: " << (end_time - start_time)/std::chrono::milliseconds(1) << " ms.\n";
+
+    unsigned max_threads = std::max(2u, std::thread::hardware_concurrency());
+    for (unsigned threads = 1; threads <= max_threads; threads *= 2)
+    {
+        start_time = std::chrono::high_resolution_clock::now();
+        auto counted = count_words_parallel(path, threads);
+        end_time = std::chrono::high_resolution_clock::now();
+
+        assert(same_counts(counted, expected));
+        std::cout << "18 MB corpus, count_words_parallel, " << threads << " threads: "
+                  << (end_time - start_time)/std::chrono::milliseconds(1) << " ms.\n";
+    }
+
+    std::remove(path);
+    return 0;
+}
 
 
 int main(){
@@ -388,7 +2333,87 @@ int main(){
     print_separator();
     test_subtract_operator();
     print_separator();
+    test_pool_allocator();
+    print_separator();
+    test_try_emplace_upsert();
+    print_separator();
+    test_heterogeneous_lookup();
+    print_separator();
+    test_custom_comparator();
+    print_separator();
+    test_iterators();
+    print_separator();
+    test_range_queries();
+    print_separator();
+    test_order_statistics();
+    print_separator();
+    test_build_from_sorted();
+    print_separator();
+    test_join_split();
+    print_separator();
+    test_set_operations();
+    print_separator();
+    test_move_semantics();
+    print_separator();
+    test_in_place_set_operations();
+    print_separator();
+    test_parallel_set_operations();
+    print_separator();
+    test_count_words_parallel();
+    print_separator();
+    test_mapped_count_words();
+    print_separator();
+    test_simd_word_scan();
+    print_separator();
+    test_string_arena();
+    print_separator();
+    test_key_prefix();
+    print_separator();
+    test_compact_tree();
+    print_separator();
+    test_frozen_tree();
+    print_separator();
+    test_kary_tree();
+    print_separator();
+    test_find_batch();
+    print_separator();
+    test_insert_sorted_batch();
+    print_separator();
+    test_hinted_insert_find();
+    print_separator();
+    test_persistent_tree();
+    print_separator();
     test_count_words();
+    print_separator();
+    test_tree_throughput();
+    print_separator();
+    test_comparison_count();
+    print_separator();
+    test_bulk_build();
+    print_separator();
+    test_parallel_scaling();
+    print_separator();
+    test_count_words_scaling();
+    print_separator();
+    test_mapped_count_words_speed();
+    print_separator();
+    test_word_scan_speed();
+    print_separator();
+    test_word_count_tree_speed();
+    print_separator();
+    test_prefix_compare_speed();
+    print_separator();
+    test_compact_tree_speed();
+    print_separator();
+    test_frozen_lookup_speed();
+    print_separator();
+    test_find_batch_speed();
+    print_separator();
+    test_sorted_batch_speed();
+    print_separator();
+    test_hinted_insert_speed();
+    print_separator();
+    test_persistent_snapshot_speed();
     
     return 0;
 }
\ No newline at end of file
@@ -12,6 +12,46 @@ void test_for_each();
 void test_maxinfo_selector();
 void test_add_operator();
 void test_subtract_operator();
+void test_pool_allocator();
+void test_try_emplace_upsert();
+void test_heterogeneous_lookup();
+void test_custom_comparator();
+void test_iterators();
+void test_range_queries();
+void test_order_statistics();
+void test_build_from_sorted();
+void test_join_split();
+void test_set_operations();
+void test_move_semantics();
+void test_in_place_set_operations();
+void test_parallel_set_operations();
+void test_count_words_parallel();
+void test_mapped_count_words();
+void test_simd_word_scan();
+void test_string_arena();
+void test_key_prefix();
+void test_compact_tree();
+void test_frozen_tree();
+void test_kary_tree();
+void test_find_batch();
+void test_insert_sorted_batch();
+void test_hinted_insert_find();
+void test_persistent_tree();
 int test_count_words();
+int test_tree_throughput();
+int test_comparison_count();
+int test_bulk_build();
+int test_parallel_scaling();
+int test_count_words_scaling();
+int test_mapped_count_words_speed();
+int test_word_scan_speed();
+int test_word_count_tree_speed();
+int test_prefix_compare_speed();
+int test_compact_tree_speed();
+int test_frozen_lookup_speed();
+int test_find_batch_speed();
+int test_sorted_batch_speed();
+int test_hinted_insert_speed();
+int test_persistent_snapshot_speed();
 
 #endif
\ No newline at end of file
@@ -0,0 +1,367 @@
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#pragma once
+
+/**
+ * @brief AVL tree stored in one contiguous vector, for large trees of small keys.
+ * Nodes refer to their children by 29-bit indices and keep their 6-bit height in the 3 spare bits of each index,
+ * there are no parent links. For int keys and info a node takes 16 bytes instead of the 40 of an avl_tree node
+ * plus its heap block. A tree holds up to 2^29 - 1 elements.
+ * Index 0 is an empty sentinel node of height 0, so missing children need no special case.
+ * Freed nodes are recycled through a free list, clear() keeps the memory for the next elements.
+ * Key and Info have to be default constructible.
+ */
+template <typename Key, typename Info, typename Compare = std::less<>>
+class compact_avl_tree{
+private:
+    using index = std::uint32_t;
+
+    static constexpr int index_bits = 29;
+    static constexpr index max_index = (index(1) << index_bits) - 1;
+
+    // Height is split into the high bits kept next to left and the low bits kept next to right
+    struct Node{
+        Key key;
+        Info info;
+        index left : index_bits;
+        index height_high : 32 - index_bits;
+        index right : index_bits;
+        index height_low : 32 - index_bits;
+    };
+
+    // AVL tree with n nodes is at most ~1.44 * log2(n) high, for n < 2^29 it is below 48
+    static constexpr int max_height = 48;
+
+    std::vector<Node> nodes = std::vector<Node>(1, make_node(Key(), Info(), 0));
+    index root = 0;
+    index free_list = 0;    // freed nodes linked through their left index
+    int size = 0;
+    Compare comp;
+
+    static Node make_node(const Key& key, const Info& info, int height){
+        Node node{key, info, 0, 0, 0, 0};
+        set_height(node, height);
+        return node;
+    }
+
+    static int height(const Node& node){
+        return static_cast<int>(node.height_high << (32 - index_bits) | node.height_low);
+    }
+
+    static void set_height(Node& node, int height){
+        node.height_high = static_cast<index>(height) >> (32 - index_bits);
+        node.height_low = static_cast<index>(height) & ((index(1) << (32 - index_bits)) - 1);
+    }
+
+    int compare(const Key& a, const Key& b) const{
+        if (comp(a, b)) return -1;
+        return comp(b, a) ? 1 : 0;
+    }
+
+    void update_height(index n){
+        Node &node = nodes[n];
+        set_height(node, 1 + std::max(height(nodes[node.left]), height(nodes[node.right])));
+    }
+
+    int balance_factor(index n) const{
+        return height(nodes[nodes[n].left]) - height(nodes[nodes[n].right]);
+    }
+
+    index rotate_right(index n){
+        index new_root = nodes[n].left;
+        nodes[n].left = nodes[new_root].right;
+        nodes[new_root].right = n;
+
+        update_height(n);
+        update_height(new_root);
+        return new_root;
+    }
+
+    index rotate_left(index n){
+        index new_root = nodes[n].right;
+        nodes[n].right = nodes[new_root].left;
+        nodes[new_root].left = n;
+
+        update_height(n);
+        update_height(new_root);
+        return new_root;
+    }
+
+    index balance(index n){
+        update_height(n);
+
+        int b_factor = balance_factor(n);
+        if (b_factor > 1){
+            if (balance_factor(nodes[n].left) < 0) nodes[n].left = rotate_left(nodes[n].left);
+            return rotate_right(n);
+        }
+        if (b_factor < -1){
+            if (balance_factor(nodes[n].right) > 0) nodes[n].right = rotate_right(nodes[n].right);
+            return rotate_left(n);
+        }
+        return n;
+    }
+
+    // Retraces path[0, depth) bottom up, went_left[i] tells which child of path[i] the path continued to.
+    // Stops as soon as a subtree keeps its height.
+    void rebalance_path(const index path[], const bool went_left[], int depth){
+        while (depth-- > 0){
+            index n = path[depth];
+            int old_height = height(nodes[n]);
+
+            index new_root = balance(n);
+            if (depth == 0) root = new_root;
+            else if (went_left[depth - 1]) nodes[path[depth - 1]].left = new_root;
+            else nodes[path[depth - 1]].right = new_root;
+
+            if (height(nodes[new_root]) == old_height) break;
+        }
+    }
+
+    index create_node(const Key& key, const Info& info){
+        if (free_list != 0){
+            index n = free_list;
+            free_list = nodes[n].left;
+            nodes[n] = make_node(key, info, 1);
+            return n;
+        }
+
+        if (nodes.size() > max_index) throw std::length_error("compact_avl_tree: too many nodes");
+        nodes.push_back(make_node(key, info, 1));
+        return static_cast<index>(nodes.size() - 1);
+    }
+
+    void destroy_node(index n){
+        // Resources held by key and info are released right away
+        nodes[n] = make_node(Key(), Info(), 0);
+        nodes[n].left = free_list;
+        free_list = n;
+    }
+
+    index find_node(const Key& key) const{
+        index n = root;
+        while (n != 0){
+            int order = compare(key, nodes[n].key);
+            if (order == 0) break;
+
+            n = (order < 0) ? nodes[n].left : nodes[n].right;
+        }
+        return n;
+    }
+
+    // Returns index of the node with the key, a node with info is created if key is not in the tree
+    index insert_helper(const Key& key, const Info& info, bool& inserted){
+        index path[max_height + 1];
+        bool went_left[max_height + 1];
+        int depth = 0;
+
+        index n = root;
+        while (n != 0){
+            int order = compare(key, nodes[n].key);
+            if (order == 0){
+                inserted = false;
+                return n;
+            }
+
+            path[depth] = n;
+            went_left[depth++] = order < 0;
+            n = (order < 0) ? nodes[n].left : nodes[n].right;
+        }
+
+        // Indices stay valid when the vector grows, references into it do not
+        index new_node = create_node(key, info);
+        size++;
+        inserted = true;
+
+        if (depth == 0) root = new_node;
+        else if (went_left[depth - 1]) nodes[path[depth - 1]].left = new_node;
+        else nodes[path[depth - 1]].right = new_node;
+
+        rebalance_path(path, went_left, depth);
+        return new_node;
+    }
+
+    template <typename Fn, typename Tree>
+    static void in_order(Tree& tree, Fn& fn){
+        index stack[max_height];
+        int depth = 0;
+
+        index n = tree.root;
+        while (n != 0 || depth > 0){
+            while (n != 0){
+                stack[depth++] = n;
+                n = tree.nodes[n].left;
+            }
+
+            n = stack[--depth];
+            const Key &key = tree.nodes[n].key;
+            fn(key, tree.nodes[n].info);
+            n = tree.nodes[n].right;
+        }
+    }
+
+    bool is_balanced_helper(index n) const{
+        if (n == 0) return true;
+
+        int b_factor = balance_factor(n);
+        if (b_factor < -1 || b_factor > 1) return false;
+
+        return is_balanced_helper(nodes[n].left) && is_balanced_helper(nodes[n].right);
+    }
+
+public:
+    // Bytes taken by one node in the vector
+    static constexpr std::size_t node_bytes = sizeof(Node);
+
+    compact_avl_tree() {}
+
+    bool empty() const{
+        return size == 0;
+    }
+
+    int get_size() const{
+        return size;
+    }
+
+    // Bytes held by the node vector, spare capacity and the sentinel included
+    std::size_t memory_usage() const{
+        return nodes.capacity() * sizeof(Node);
+    }
+
+    /**
+     * @brief makes room for count elements, so inserting them does not move the nodes
+     *
+     * @param count is the number of elements
+     */
+    void reserve(std::size_t count){
+        nodes.reserve(count + 1);
+    }
+
+    /**
+     * @brief removes all elements, memory of the nodes is kept for reuse
+     *
+     */
+    void clear(){
+        nodes.resize(1);
+        root = 0;
+        free_list = 0;
+        size = 0;
+    }
+
+    /**
+     * @brief Inserts element to the tree or assigns info to the existing one
+     *
+     * @param key is the key that will be inserted
+     * @param info is info that will be inserted or assigned
+     */
+    void insert(const Key& key, const Info& info){
+        bool inserted;
+        index n = insert_helper(key, info, inserted);
+        if (!inserted) nodes[n].info = info;
+    }
+
+    /**
+     * @brief Updates info of the element in place. If key is not in the tree, element with default constructed info is inserted first.
+     *
+     * @param key is the key that will be searched or inserted
+     * @param fn is function called with Info& of the element
+     * @return true if element was inserted
+     */
+    template <typename Fn>
+    bool upsert(const Key& key, Fn fn){
+        bool inserted;
+        index n = insert_helper(key, Info(), inserted);
+        fn(nodes[n].info);
+        return inserted;
+    }
+
+    /**
+     * @brief removes element from the tree
+     *
+     * @param key is the key that will be removed
+     * @return true if element was removed
+     * @return false if element not exists
+     */
+    bool remove(const Key& key){
+        index path[max_height + 1];
+        bool went_left[max_height + 1];
+        int depth = 0;
+
+        index n = root;
+        while (n != 0){
+            int order = compare(key, nodes[n].key);
+            if (order == 0) break;
+
+            path[depth] = n;
+            went_left[depth++] = order < 0;
+            n = (order < 0) ? nodes[n].left : nodes[n].right;
+        }
+        if (n == 0) return false;
+
+        // Node with two children takes the element of its successor, the successor node is unlinked instead
+        index victim = n;
+        if (nodes[n].left != 0 && nodes[n].right != 0){
+            path[depth] = n;
+            went_left[depth++] = false;
+            victim = nodes[n].right;
+            while (nodes[victim].left != 0){
+                path[depth] = victim;
+                went_left[depth++] = true;
+                victim = nodes[victim].left;
+            }
+            nodes[n].key = std::move(nodes[victim].key);
+            nodes[n].info = std::move(nodes[victim].info);
+        }
+
+        index child = (nodes[victim].left != 0) ? nodes[victim].left : nodes[victim].right;
+        if (depth == 0) root = child;
+        else if (went_left[depth - 1]) nodes[path[depth - 1]].left = child;
+        else nodes[path[depth - 1]].right = child;
+
+        destroy_node(victim);
+        size--;
+
+        rebalance_path(path, went_left, depth);
+        return true;
+    }
+
+    /**
+     * @brief searches for element in the tree
+     *
+     * @param key is the key that will be searched
+     * @return true if element found
+     */
+    bool find(const Key& key) const{
+        return find_node(key) != 0;
+    }
+
+    // Returns info of the element, element with default info is inserted if key is not in the tree
+    Info& operator[](const Key& key){
+        bool inserted;
+        return nodes[insert_helper(key, Info(), inserted)].info;
+    }
+
+    /**
+     * @brief returns info of the element
+     *
+     * @throw std::runtime_error if key is not in the tree
+     */
+    const Info& operator[](const Key& key) const{
+        index n = find_node(key);
+        if (n == 0) throw std::runtime_error("Key not found");
+        return nodes[n].info;
+    }
+
+    // Calls fn(key, info) for all elements in key order
+    template <typename Fn> void for_each(Fn fn) { in_order(*this, fn); }
+
+    template <typename Fn> void traverse(Fn fn) const { in_order(*this, fn); }
+
+    // Function designed just for testing
+    bool is_balanced() const { return is_balanced_helper(root); }
+};
@@ -0,0 +1,216 @@
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <stdexcept>
+#include <vector>
+
+#pragma once
+
+/**
+ * @brief Immutable sorted dictionary in Eytzinger layout, made by avl_tree::freeze().
+ * Keys are stored breadth first in one array: the children of the element at 1-based position k are at 2k and 2k + 1.
+ * The top levels of every search share a few cache lines, and since the positions visited next are known in advance
+ * the search prefetches the cache line holding the keys four levels below the current one.
+ * Info is kept in a parallel array, so searches read keys only.
+ */
+template <typename Key, typename Info, typename Compare = std::less<>>
+class frozen_avl_tree{
+private:
+    std::vector<Key> keys;      // keys[k - 1] is the key at 1-based position k
+    std::vector<Info> infos;
+    Compare comp;
+
+    // Trailing one bits of k, the number of levels to climb from k after falling off a leaf
+    static int trailing_ones(std::size_t k){
+#if defined(__GNUC__)
+        return __builtin_ctzll(~static_cast<unsigned long long>(k));
+#else
+        int count = 0;
+        while (k & 1){
+            k >>= 1;
+            count++;
+        }
+        return count;
+#endif
+    }
+
+    std::size_t count() const { return keys.size(); }
+
+    // Position of the smallest key, 0 when empty
+    std::size_t first_position() const{
+        std::size_t k = 0;
+        if (count() > 0) for (k = 1; 2 * k <= count(); k *= 2);
+        return k;
+    }
+
+    // In-order successor of position k, 0 past the last key
+    std::size_t next_position(std::size_t k) const{
+        if (2 * k + 1 <= count()){
+            k = 2 * k + 1;
+            while (2 * k <= count()) k *= 2;
+            return k;
+        }
+        return k >> (trailing_ones(k) + 1);
+    }
+
+    void prefetch(std::size_t k) const{
+#if defined(__GNUC__)
+        // 16 positions below k are the descendants four levels down, they are contiguous.
+        // Address is only a hint, it is not dereferenced even if it lies past the array.
+        std::uintptr_t address = reinterpret_cast<std::uintptr_t>(keys.data()) + (16 * k - 1) * sizeof(Key);
+        __builtin_prefetch(reinterpret_cast<const void*>(address));
+#endif
+    }
+
+    // Position of the first key not less than key, or greater than key if strict is set; 0 if there is none
+    template <typename K>
+    std::size_t bound_position(const K& key, bool strict) const{
+        std::size_t k = 1;
+        while (k <= count()){
+            prefetch(k);
+            bool go_right = strict ? !comp(key, keys[k - 1]) : comp(keys[k - 1], key);
+            k = 2 * k + go_right;
+        }
+        // The answer is the last position where the search went left
+        return k >> (trailing_ones(k) + 1);
+    }
+
+    template <typename K>
+    std::size_t find_position(const K& key) const{
+        std::size_t k = bound_position(key, false);
+        return (k != 0 && !comp(key, keys[k - 1])) ? k : 0;
+    }
+
+public:
+    // Element seen through an iterator, with the key and info fields of an avl_tree element
+    struct element{
+        const Key& key;
+        const Info& info;
+    };
+
+    // Visits elements in key order
+    class const_iterator{
+    private:
+        const frozen_avl_tree *tree = nullptr;
+        std::size_t position = 0;
+
+        friend class frozen_avl_tree;
+
+        const_iterator(const frozen_avl_tree* tree, std::size_t position): tree(tree), position(position) {}
+
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = element;
+        using difference_type = std::ptrdiff_t;
+        using reference = element;
+
+        struct pointer{
+            element value;
+            const element* operator->() const { return &value; }
+        };
+
+        const_iterator() {}
+
+        element operator*() const { return element{tree->keys[position - 1], tree->infos[position - 1]}; }
+        pointer operator->() const { return pointer{**this}; }
+
+        const_iterator& operator++(){
+            position = tree->next_position(position);
+            return *this;
+        }
+
+        const_iterator operator++(int){
+            const_iterator old = *this;
+            ++*this;
+            return old;
+        }
+
+        friend bool operator==(const const_iterator& a, const const_iterator& b) { return a.position == b.position; }
+        friend bool operator!=(const const_iterator& a, const const_iterator& b) { return a.position != b.position; }
+    };
+
+    using iterator = const_iterator;
+
+    frozen_avl_tree() {}
+
+    /**
+     * @brief Builds the layout from elements sorted by key
+     *
+     * @param first is iterator to the first element, elements have key and info fields
+     * @param last is iterator past the last element
+     * @param comp is the comparator the elements are sorted by
+     */
+    template <typename It>
+    frozen_avl_tree(It first, It last, Compare comp = Compare()): comp(comp){
+        std::vector<It> sorted;
+        for (; first != last; ++first) sorted.push_back(first);
+
+        // rank[k] is the in-order rank of position k
+        std::vector<std::size_t> rank(sorted.size() + 1);
+        keys.reserve(sorted.size());
+        infos.reserve(sorted.size());
+        std::size_t n = sorted.size();
+        std::size_t k = 0;
+        if (n > 0) for (k = 1; 2 * k <= n; k *= 2);
+        for (std::size_t r = 0; r < n; ++r){
+            rank[k] = r;
+            if (2 * k + 1 <= n){
+                k = 2 * k + 1;
+                while (2 * k <= n) k *= 2;
+            }
+            else k >>= trailing_ones(k) + 1;
+        }
+
+        for (k = 1; k <= n; ++k){
+            keys.push_back(sorted[rank[k]]->key);
+            infos.push_back(sorted[rank[k]]->info);
+        }
+    }
+
+    bool empty() const{
+        return keys.empty();
+    }
+
+    int get_size() const{
+        return static_cast<int>(keys.size());
+    }
+
+    const_iterator begin() const { return const_iterator(this, first_position()); }
+    const_iterator end() const { return const_iterator(this, 0); }
+
+    /**
+     * @brief searches for element
+     *
+     * @param key is the key that will be searched
+     * @return true if element found
+     */
+    template <typename K>
+    bool find(const K& key) const{
+        return find_position(key) != 0;
+    }
+
+    /**
+     * @brief returns info of the element
+     *
+     * @throw std::runtime_error if key is not in the tree
+     */
+    template <typename K>
+    const Info& operator[](const K& key) const{
+        std::size_t k = find_position(key);
+        if (k == 0) throw std::runtime_error("Key not found");
+        return infos[k - 1];
+    }
+
+    // First element with key not less than key
+    template <typename K>
+    const_iterator lower_bound(const K& key) const { return const_iterator(this, bound_position(key, false)); }
+
+    // First element with key greater than key
+    template <typename K>
+    const_iterator upper_bound(const K& key) const { return const_iterator(this, bound_position(key, true)); }
+
+    template <typename Fn> void traverse(Fn fn) const{
+        for (element e : *this) fn(e.key, e.info);
+    }
+};
@@ -0,0 +1,288 @@
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+// AVX2 block search needs x86-64 and GCC or Clang for runtime dispatch, as in word_scan.h.
+// Define AVL_TREE_NO_SIMD to always use the scalar loop.
+#if !defined(AVL_TREE_NO_SIMD) && defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define FROZEN_KARY_X86 1
+#else
+#define FROZEN_KARY_X86 0
+#endif
+
+#pragma once
+
+/**
+ * @brief Immutable sorted dictionary of arithmetic keys in a static k-ary search layout (a B+ tree without pointers).
+ * Sorted keys are cut into 64-byte leaf blocks of B keys, B is 16 for 32-bit keys. Above them are layers of index blocks,
+ * every index block holds the smallest keys of its children 2 to B + 1, so one block decides between B + 1 children.
+ * A lookup reads one cache line per layer, about log17(n) of them for int keys, and finds the child with
+ * two AVX2 compares of the probe against the whole block. Positions come from arithmetic, there are no pointers.
+ * 32 and 64-bit signed integer keys use AVX2 when the CPU has it, other keys and other CPUs use a scalar loop.
+ * Made by avl_tree::freeze<frozen_kary_tree<Key, Info>>(), the order is the natural order of the keys.
+ */
+template <typename Key, typename Info>
+class frozen_kary_tree{
+    static_assert(std::is_arithmetic<Key>::value, "frozen_kary_tree needs arithmetic keys");
+
+private:
+    // Keys per block, a block fills one cache line
+    static constexpr std::size_t B = 64 / sizeof(Key);
+
+    struct alignas(64) Block{
+        Key keys[B];
+    };
+
+    static constexpr bool simd_keys = std::is_integral<Key>::value && std::is_signed<Key>::value
+                                      && (sizeof(Key) == 4 || sizeof(Key) == 8);
+
+    std::vector<Block> leaves;                  // sorted keys padded with the largest key value
+    std::vector<Block> nodes;                   // index layers, root first
+    std::vector<std::size_t> layer_offset;      // first block of every index layer in nodes
+    std::vector<Info> infos;                    // in key order
+    std::size_t size = 0;
+
+    const Key& key_at(std::size_t rank) const { return leaves[rank / B].keys[rank % B]; }
+
+    // Number of keys in the block less than probe, or not greater than probe if strict is set
+    static std::size_t count_scalar(const Key* keys, const Key& probe, bool strict){
+        std::size_t count = 0;
+        for (std::size_t i = 0; i < B; ++i) count += strict ? !(probe < keys[i]) : (keys[i] < probe);
+        return count;
+    }
+
+    std::size_t search_scalar(const Key& probe, bool strict) const{
+        std::size_t j = 0;
+        for (std::size_t d = 0; d < layer_offset.size(); ++d){
+            j = j * (B + 1) + count_scalar(nodes[layer_offset[d] + j].keys, probe, strict);
+        }
+        return j * B + count_scalar(leaves[j].keys, probe, strict);
+    }
+
+#if FROZEN_KARY_X86
+    __attribute__((target("avx2")))
+    static std::size_t count_avx2(const void* keys, std::int32_t probe, bool strict){
+        const __m256i *block = static_cast<const __m256i*>(keys);
+        __m256i p = _mm256_set1_epi32(probe);
+        __m256i low = _mm256_load_si256(block), high = _mm256_load_si256(block + 1);
+        if (strict){
+            // Keys not greater than probe are the ones that are not flagged greater
+            unsigned greater = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(low, p)))
+                               | (_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(high, p))) << 8);
+            return B - __builtin_popcount(greater);
+        }
+        unsigned less = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(p, low)))
+                        | (_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(p, high))) << 8);
+        return __builtin_popcount(less);
+    }
+
+    __attribute__((target("avx2")))
+    static std::size_t count_avx2(const void* keys, std::int64_t probe, bool strict){
+        const __m256i *block = static_cast<const __m256i*>(keys);
+        __m256i p = _mm256_set1_epi64x(probe);
+        __m256i low = _mm256_load_si256(block), high = _mm256_load_si256(block + 1);
+        if (strict){
+            unsigned greater = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(low, p)))
+                               | (_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(high, p))) << 4);
+            return B - __builtin_popcount(greater);
+        }
+        unsigned less = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(p, low)))
+                        | (_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(p, high))) << 4);
+        return __builtin_popcount(less);
+    }
+
+    // Same walk as search_scalar(), only called for simd_keys
+    __attribute__((target("avx2")))
+    std::size_t search_avx2(const Key& probe, bool strict) const{
+        using lane = std::conditional_t<sizeof(Key) == 4, std::int32_t, std::int64_t>;
+        std::size_t j = 0;
+        for (std::size_t d = 0; d < layer_offset.size(); ++d){
+            j = j * (B + 1) + count_avx2(nodes[layer_offset[d] + j].keys, static_cast<lane>(probe), strict);
+        }
+        return j * B + count_avx2(leaves[j].keys, static_cast<lane>(probe), strict);
+    }
+
+    static bool has_avx2(){
+        static const bool supported = __builtin_cpu_supports("avx2");
+        return supported;
+    }
+#endif
+
+    // Rank of the first key not less than probe, or greater than probe if strict is set; size if there is none
+    std::size_t bound_rank(const Key& probe, bool strict) const{
+        // Past the last key the walk could follow padding into blocks that do not exist
+        if (size == 0) return 0;
+        const Key &last = key_at(size - 1);
+        if (strict ? !(probe < last) : (last < probe)) return size;
+
+#if FROZEN_KARY_X86
+        if constexpr (simd_keys){
+            if (has_avx2()) return search_avx2(probe, strict);
+        }
+#endif
+        return search_scalar(probe, strict);
+    }
+
+    std::size_t find_rank(const Key& probe) const{
+        std::size_t rank = bound_rank(probe, false);
+        return (rank != size && !(probe < key_at(rank))) ? rank : size;
+    }
+
+public:
+    // Element seen through an iterator, with the key and info fields of an avl_tree element
+    struct element{
+        const Key& key;
+        const Info& info;
+    };
+
+    // Visits elements in key order
+    class const_iterator{
+    private:
+        const frozen_kary_tree *tree = nullptr;
+        std::size_t rank = 0;
+
+        friend class frozen_kary_tree;
+
+        const_iterator(const frozen_kary_tree* tree, std::size_t rank): tree(tree), rank(rank) {}
+
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = element;
+        using difference_type = std::ptrdiff_t;
+        using reference = element;
+
+        struct pointer{
+            element value;
+            const element* operator->() const { return &value; }
+        };
+
+        const_iterator() {}
+
+        element operator*() const { return element{tree->key_at(rank), tree->infos[rank]}; }
+        pointer operator->() const { return pointer{**this}; }
+
+        const_iterator& operator++(){
+            ++rank;
+            return *this;
+        }
+
+        const_iterator operator++(int){
+            const_iterator old = *this;
+            ++*this;
+            return old;
+        }
+
+        friend bool operator==(const const_iterator& a, const const_iterator& b) { return a.rank == b.rank; }
+        friend bool operator!=(const const_iterator& a, const const_iterator& b) { return a.rank != b.rank; }
+    };
+
+    using iterator = const_iterator;
+
+    frozen_kary_tree() {}
+
+    /**
+     * @brief Builds the layout from elements sorted by key
+     *
+     * @param first is iterator to the first element, elements have key and info fields
+     * @param last is iterator past the last element
+     * @param comp is the comparator the elements are sorted by, it has to be the natural order of the keys
+     */
+    template <typename It, typename Compare = std::less<>>
+    frozen_kary_tree(It first, It last, const Compare& comp = Compare()){
+        static_assert(std::is_same<Compare, std::less<>>::value || std::is_same<Compare, std::less<Key>>::value,
+                      "frozen_kary_tree searches keys in their natural order");
+
+        std::vector<Key> sorted;
+        for (; first != last; ++first){
+            sorted.push_back(first->key);
+            infos.push_back(first->info);
+        }
+        size = sorted.size();
+
+        // Padding is never less than a probe, so searches never go right of the real keys
+        const Key padding = std::numeric_limits<Key>::max();
+        leaves.resize((size + B - 1) / B);
+        for (std::size_t i = 0; i < leaves.size() * B; ++i) leaves[i / B].keys[i % B] = (i < size) ? sorted[i] : padding;
+
+        // Index layers are built bottom up from the smallest key of every block of the layer below
+        std::vector<std::vector<Block>> layers;
+        std::vector<Key> mins(leaves.size());
+        for (std::size_t j = 0; j < leaves.size(); ++j) mins[j] = leaves[j].keys[0];
+
+        while (mins.size() > 1){
+            std::size_t below = mins.size();
+            std::vector<Block> layer((below + B) / (B + 1));
+            std::vector<Key> layer_mins(layer.size());
+            for (std::size_t j = 0; j < layer.size(); ++j){
+                layer_mins[j] = mins[j * (B + 1)];
+                for (std::size_t i = 0; i < B; ++i){
+                    std::size_t child = j * (B + 1) + i + 1;
+                    layer[j].keys[i] = (child < below) ? mins[child] : padding;
+                }
+            }
+            layers.push_back(std::move(layer));
+            mins = std::move(layer_mins);
+        }
+
+        for (auto layer = layers.rbegin(); layer != layers.rend(); ++layer){
+            layer_offset.push_back(nodes.size());
+            nodes.insert(nodes.end(), layer->begin(), layer->end());
+        }
+    }
+
+    bool empty() const{
+        return size == 0;
+    }
+
+    int get_size() const{
+        return static_cast<int>(size);
+    }
+
+    // Name of the block search used on this CPU
+    static const char* search_name(){
+#if FROZEN_KARY_X86
+        if (simd_keys && has_avx2()) return "avx2";
+#endif
+        return "scalar";
+    }
+
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, size); }
+
+    /**
+     * @brief searches for element
+     *
+     * @param key is the key that will be searched
+     * @return true if element found
+     */
+    bool find(const Key& key) const{
+        return find_rank(key) != size;
+    }
+
+    /**
+     * @brief returns info of the element
+     *
+     * @throw std::runtime_error if key is not in the tree
+     */
+    const Info& operator[](const Key& key) const{
+        std::size_t rank = find_rank(key);
+        if (rank == size) throw std::runtime_error("Key not found");
+        return infos[rank];
+    }
+
+    // First element with key not less than key
+    const_iterator lower_bound(const Key& key) const { return const_iterator(this, bound_rank(key, false)); }
+
+    // First element with key greater than key
+    const_iterator upper_bound(const Key& key) const { return const_iterator(this, bound_rank(key, true)); }
+
+    template <typename Fn> void traverse(Fn fn) const{
+        for (std::size_t rank = 0; rank < size; ++rank) fn(key_at(rank), infos[rank]);
+    }
+};
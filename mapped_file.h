@@ -0,0 +1,88 @@
+#include <cstddef>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define MAPPED_FILE_MMAP 1
+#else
+#define MAPPED_FILE_MMAP 0
+#endif
+
+#pragma once
+
+/**
+ * @brief Read-only view of a whole file.
+ * On POSIX systems the file is memory-mapped and pages are read in by the kernel as they are touched,
+ * elsewhere it is read into a buffer once. Either way view() stays valid for the lifetime of the object.
+ */
+class mapped_file{
+private:
+    const char *begin = nullptr;
+    std::size_t length = 0;
+    std::vector<char> buffer;   // file contents when it is not mapped
+
+public:
+    /**
+     * @brief maps the file
+     *
+     * @param path is path of the file
+     * @throw std::runtime_error if the file cannot be opened or mapped
+     */
+    explicit mapped_file(const std::string& path){
+#if MAPPED_FILE_MMAP
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) throw std::runtime_error("mapped_file: cannot open " + path);
+
+        struct stat info;
+        if (::fstat(fd, &info) != 0){
+            ::close(fd);
+            throw std::runtime_error("mapped_file: cannot read size of " + path);
+        }
+        length = static_cast<std::size_t>(info.st_size);
+
+        // Empty files cannot be mapped, they simply have no contents
+        if (length > 0){
+            void *address = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (address == MAP_FAILED){
+                ::close(fd);
+                throw std::runtime_error("mapped_file: cannot map " + path);
+            }
+            ::madvise(address, length, MADV_SEQUENTIAL);
+            begin = static_cast<const char*>(address);
+        }
+        // The mapping keeps the file open on its own
+        ::close(fd);
+#else
+        std::ifstream is(path, std::ios::binary | std::ios::ate);
+        if (!is) throw std::runtime_error("mapped_file: cannot open " + path);
+
+        buffer.resize(static_cast<std::size_t>(is.tellg()));
+        is.seekg(0);
+        is.read(buffer.data(), buffer.size());
+        begin = buffer.data();
+        length = buffer.size();
+#endif
+    }
+
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    ~mapped_file(){
+#if MAPPED_FILE_MMAP
+        if (begin != nullptr) ::munmap(const_cast<char*>(begin), length);
+#endif
+    }
+
+    const char* data() const { return begin; }
+
+    std::size_t size() const { return length; }
+
+    std::string_view view() const { return std::string_view(begin, length); }
+};
@@ -0,0 +1,325 @@
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <stdexcept>
+#include <utility>
+
+#pragma once
+
+/**
+ * @brief Persistent AVL tree: every version is an immutable value and updates return a new version.
+ * Nodes are reference counted and shared between versions. insert() and remove() copy only the nodes on the path
+ * they change, O(log n) of them, and the new version points to every other subtree of the old one.
+ * Copying a version is O(1), so it serves as a snapshot that stays valid however the other versions change.
+ * Reference counts are atomic: versions may be copied, read and destroyed on different threads,
+ * only one object must not be assigned while another thread uses it, as with std::shared_ptr.
+ */
+template <typename Key, typename Info, typename Compare = std::less<>>
+class persistent_avl_tree{
+private:
+    struct Node{
+        mutable std::atomic<int> refs{1};
+        int height;
+        const Node *left;
+        const Node *right;
+        Key key;
+        Info info;
+
+        template <typename K, typename I>
+        Node(K&& key, I&& info, const Node* left, const Node* right, int height):
+            height(height), left(left), right(right), key(std::forward<K>(key)), info(std::forward<I>(info)) {}
+    };
+
+    const Node *root = nullptr;
+    int size = 0;
+    Compare comp;
+
+    persistent_avl_tree(const Node* root, int size, const Compare& comp): root(root), size(size), comp(comp) {}
+
+    template <typename K1, typename K2>
+    int compare(const K1& a, const K2& b) const{
+        if (comp(a, b)) return -1;
+        return comp(b, a) ? 1 : 0;
+    }
+
+    static const Node* retain(const Node* node){
+        if (node != nullptr) node->refs.fetch_add(1, std::memory_order_relaxed);
+        return node;
+    }
+
+    // Drops one reference, nodes nobody refers to any more are freed together with the references they hold
+    static void release(const Node* node){
+        while (node != nullptr && node->refs.fetch_sub(1, std::memory_order_acq_rel) == 1){
+            release(node->left);
+            const Node *right = node->right;
+            delete node;
+            node = right;
+        }
+    }
+
+    // Takes over one reference to node and returns a node that may be changed: node itself when no other version
+    // or node refers to it, otherwise a copy that refers to the same children. This is where paths are copied.
+    static Node* own(const Node* node){
+        if (node->refs.load(std::memory_order_acquire) == 1) return const_cast<Node*>(node);
+
+        Node *copy = new Node(node->key, node->info, retain(node->left), retain(node->right), node->height);
+        release(node);
+        return copy;
+    }
+
+    static int height(const Node* node){
+        return (node != nullptr) ? node->height : 0;
+    }
+
+    static void update_height(Node* node){
+        node->height = 1 + std::max(height(node->left), height(node->right));
+    }
+
+    static int balance_factor(const Node* node){
+        return height(node->left) - height(node->right);
+    }
+
+    // Rotations and balance() work on owned nodes, a child that moves is owned first
+    static Node* rotate_right(Node* node){
+        Node *new_root = own(node->left);
+        node->left = new_root->right;
+        new_root->right = node;
+
+        update_height(node);
+        update_height(new_root);
+        return new_root;
+    }
+
+    static Node* rotate_left(Node* node){
+        Node *new_root = own(node->right);
+        node->right = new_root->left;
+        new_root->left = node;
+
+        update_height(node);
+        update_height(new_root);
+        return new_root;
+    }
+
+    static Node* balance(Node* node){
+        update_height(node);
+
+        int b_factor = balance_factor(node);
+        if (b_factor > 1){
+            if (balance_factor(node->left) < 0) node->left = rotate_left(own(node->left));
+            return rotate_right(node);
+        }
+        if (b_factor < -1){
+            if (balance_factor(node->right) > 0) node->right = rotate_right(own(node->right));
+            return rotate_left(node);
+        }
+        return node;
+    }
+
+    // Functions below take over the reference to node they are given and return a reference to the new subtree
+
+    template <typename K, typename I>
+    const Node* insert_node(const Node* node, K&& key, I&& info, bool& inserted) const{
+        if (node == nullptr){
+            inserted = true;
+            return new Node(std::forward<K>(key), std::forward<I>(info), nullptr, nullptr, 1);
+        }
+
+        Node *owned = own(node);
+        int order = compare(key, owned->key);
+        if (order < 0) owned->left = insert_node(owned->left, std::forward<K>(key), std::forward<I>(info), inserted);
+        else if (order > 0) owned->right = insert_node(owned->right, std::forward<K>(key), std::forward<I>(info), inserted);
+        else{
+            inserted = false;
+            owned->info = std::forward<I>(info);
+            return owned;
+        }
+
+        return balance(owned);
+    }
+
+    // Unlinks the smallest node of the subtree, its element is moved to target
+    static const Node* remove_min(const Node* node, Node* target){
+        Node *owned = own(node);
+        if (owned->left == nullptr){
+            target->key = std::move(owned->key);
+            target->info = std::move(owned->info);
+            const Node *right = owned->right;
+            delete owned;
+            return right;
+        }
+
+        owned->left = remove_min(owned->left, target);
+        return balance(owned);
+    }
+
+    // key is known to be in the subtree
+    template <typename K>
+    const Node* remove_node(const Node* node, const K& key) const{
+        Node *owned = own(node);
+        int order = compare(key, owned->key);
+        if (order < 0) owned->left = remove_node(owned->left, key);
+        else if (order > 0) owned->right = remove_node(owned->right, key);
+        else if (owned->left == nullptr || owned->right == nullptr){
+            const Node *child = (owned->left != nullptr) ? owned->left : owned->right;
+            delete owned;
+            return child;
+        }
+        else owned->right = remove_min(owned->right, owned);
+
+        return balance(owned);
+    }
+
+    template <typename K>
+    const Node* find_node(const K& key) const{
+        const Node *node = root;
+        while (node != nullptr){
+            int order = compare(key, node->key);
+            if (order == 0) break;
+
+            node = (order < 0) ? node->left : node->right;
+        }
+
+        return node;
+    }
+
+    template <typename Fn>
+    static void in_order(const Node* node, Fn& fn){
+        while (node != nullptr){
+            in_order(node->left, fn);
+            fn(node->key, node->info);
+            node = node->right;
+        }
+    }
+
+    static bool is_balanced_helper(const Node* node){
+        if (node == nullptr) return true;
+
+        int b_factor = balance_factor(node);
+        if (b_factor < -1 || b_factor > 1) return false;
+
+        return is_balanced_helper(node->left) && is_balanced_helper(node->right);
+    }
+
+public:
+    persistent_avl_tree() {}
+
+    // Copies share all nodes, this is the O(1) snapshot
+    persistent_avl_tree(const persistent_avl_tree& src): root(retain(src.root)), size(src.size), comp(src.comp) {}
+
+    persistent_avl_tree(persistent_avl_tree&& src) noexcept: root(src.root), size(src.size), comp(src.comp){
+        src.root = nullptr;
+        src.size = 0;
+    }
+
+    persistent_avl_tree& operator=(const persistent_avl_tree& src){
+        if (&src != this){
+            const Node *old = root;
+            root = retain(src.root);
+            size = src.size;
+            comp = src.comp;
+            release(old);
+        }
+        return *this;
+    }
+
+    persistent_avl_tree& operator=(persistent_avl_tree&& src) noexcept{
+        if (&src != this){
+            release(root);
+            root = src.root;
+            size = src.size;
+            comp = src.comp;
+            src.root = nullptr;
+            src.size = 0;
+        }
+        return *this;
+    }
+
+    ~persistent_avl_tree(){
+        release(root);
+    }
+
+    bool empty() const{
+        return size == 0;
+    }
+
+    int get_size() const{
+        return size;
+    }
+
+    /**
+     * @brief returns version with the element inserted or its info assigned, this version does not change
+     *
+     * @param key is the key that will be inserted
+     * @param info is info that will be inserted or assigned
+     * @return persistent_avl_tree new version sharing all nodes off the path to key
+     */
+    template <typename K, typename I>
+    persistent_avl_tree insert(K&& key, I&& info) const &{
+        bool inserted;
+        const Node *new_root = insert_node(retain(root), std::forward<K>(key), std::forward<I>(info), inserted);
+        return persistent_avl_tree(new_root, size + inserted, comp);
+    }
+
+    // A version that is not used afterwards gives its nodes away, those only it refers to are changed in place
+    template <typename K, typename I>
+    persistent_avl_tree insert(K&& key, I&& info) &&{
+        bool inserted;
+        const Node *new_root = insert_node(root, std::forward<K>(key), std::forward<I>(info), inserted);
+        root = nullptr;
+        int new_size = size + inserted;
+        size = 0;
+        return persistent_avl_tree(new_root, new_size, comp);
+    }
+
+    /**
+     * @brief returns version without the element, this version does not change
+     *
+     * @param key is the key that will be removed
+     * @return persistent_avl_tree new version, it shares the nodes of this one if key is not there
+     */
+    template <typename K>
+    persistent_avl_tree remove(const K& key) const &{
+        if (find_node(key) == nullptr) return *this;
+        return persistent_avl_tree(remove_node(retain(root), key), size - 1, comp);
+    }
+
+    template <typename K>
+    persistent_avl_tree remove(const K& key) &&{
+        if (find_node(key) == nullptr) return std::move(*this);
+
+        const Node *new_root = remove_node(root, key);
+        root = nullptr;
+        int new_size = size - 1;
+        size = 0;
+        return persistent_avl_tree(new_root, new_size, comp);
+    }
+
+    /**
+     * @brief searches for element
+     *
+     * @param key is the key that will be searched
+     * @return true if element found
+     */
+    template <typename K>
+    bool find(const K& key) const{
+        return find_node(key) != nullptr;
+    }
+
+    /**
+     * @brief returns info of the element
+     *
+     * @throw std::runtime_error if key is not in the tree
+     */
+    template <typename K>
+    const Info& operator[](const K& key) const{
+        const Node *node = find_node(key);
+        if (node == nullptr) throw std::runtime_error("Key not found");
+        return node->info;
+    }
+
+    // Calls fn(key, info) for all elements in key order
+    template <typename Fn> void traverse(Fn fn) const { in_order(root, fn); }
+
+    // Function designed just for testing
+    bool is_balanced() const { return is_balanced_helper(root); }
+};
@@ -0,0 +1,228 @@
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#pragma once
+
+/**
+ * @brief Fork-join thread pool with work stealing.
+ * Every worker owns a deque: it pushes and pops its own tasks at the back, idle workers steal from the front.
+ * The thread that calls run() works as worker 0 until run() returns, threads - 1 more workers are started.
+ */
+class task_pool{
+private:
+    struct task{
+        void (*invoke)(void*);
+        void *fn;
+        std::exception_ptr error;
+        std::atomic<bool> done{false};
+    };
+
+    struct worker{
+        std::mutex lock;
+        std::deque<task*> tasks;
+    };
+
+    std::vector<std::unique_ptr<worker>> workers;
+    std::vector<std::thread> threads;
+
+    std::atomic<int> pending{0};            // tasks waiting in deques
+    std::atomic<bool> stopping{false};
+    std::mutex sleep_lock;
+    std::condition_variable wake_up;
+    std::mutex run_lock;                    // one external thread at a time acts as worker 0
+
+    static inline thread_local task_pool *current_pool = nullptr;
+    static inline thread_local unsigned current_index = 0;
+
+    template <typename Fn> static void invoke(void* fn) { (*static_cast<Fn*>(fn))(); }
+
+    void push(task* t){
+        worker &own = *workers[current_index];
+        {
+            std::lock_guard<std::mutex> guard(own.lock);
+            own.tasks.push_back(t);
+        }
+        pending++;
+        {
+            std::lock_guard<std::mutex> guard(sleep_lock);
+        }
+        wake_up.notify_one();
+    }
+
+    // Takes t back if nobody has stolen it yet, it is on the back of own deque then
+    bool take_back(task* t){
+        worker &own = *workers[current_index];
+        std::lock_guard<std::mutex> guard(own.lock);
+        if (own.tasks.empty() || own.tasks.back() != t) return false;
+
+        own.tasks.pop_back();
+        pending--;
+        return true;
+    }
+
+    task* find_task(){
+        {
+            worker &own = *workers[current_index];
+            std::lock_guard<std::mutex> guard(own.lock);
+            if (!own.tasks.empty()){
+                task *t = own.tasks.back();
+                own.tasks.pop_back();
+                pending--;
+                return t;
+            }
+        }
+
+        for (std::size_t i = 1; i < workers.size(); ++i){
+            worker &victim = *workers[(current_index + i) % workers.size()];
+            std::lock_guard<std::mutex> guard(victim.lock);
+            if (!victim.tasks.empty()){
+                task *t = victim.tasks.front();
+                victim.tasks.pop_front();
+                pending--;
+                return t;
+            }
+        }
+
+        return nullptr;
+    }
+
+    static void execute(task* t){
+        try {
+            t->invoke(t->fn);
+        } catch (...) {
+            t->error = std::current_exception();
+        }
+        t->done.store(true, std::memory_order_release);
+    }
+
+    bool run_one(){
+        task *t = find_task();
+        if (t == nullptr) return false;
+
+        execute(t);
+        return true;
+    }
+
+    void worker_loop(unsigned index){
+        current_pool = this;
+        current_index = index;
+
+        while (!stopping.load()){
+            if (run_one()) continue;
+
+            std::unique_lock<std::mutex> guard(sleep_lock);
+            wake_up.wait(guard, [this] { return stopping.load() || pending.load() > 0; });
+        }
+    }
+
+public:
+    /**
+     * @brief starts the pool
+     *
+     * @param thread_count is the number of threads working on tasks, including the one that calls run()
+     */
+    explicit task_pool(unsigned thread_count = std::thread::hardware_concurrency()){
+        if (thread_count == 0) thread_count = 1;
+
+        for (unsigned i = 0; i < thread_count; ++i){
+            workers.emplace_back(new worker);
+        }
+        for (unsigned i = 1; i < thread_count; ++i){
+            threads.emplace_back(&task_pool::worker_loop, this, i);
+        }
+    }
+
+    task_pool(const task_pool&) = delete;
+    task_pool& operator=(const task_pool&) = delete;
+
+    ~task_pool(){
+        {
+            std::lock_guard<std::mutex> guard(sleep_lock);
+            stopping = true;
+        }
+        wake_up.notify_all();
+
+        for (std::thread &thread : threads) thread.join();
+    }
+
+    unsigned get_threads() const{
+        return static_cast<unsigned>(workers.size());
+    }
+
+    /**
+     * @brief runs fn on the calling thread, fork_join() calls inside it are spread over the pool
+     *
+     * @param fn is function that will be called
+     */
+    template <typename Fn>
+    void run(Fn&& fn){
+        if (current_pool == this){
+            fn();
+            return;
+        }
+
+        std::lock_guard<std::mutex> guard(run_lock);
+        task_pool *outer_pool = current_pool;
+        unsigned outer_index = current_index;
+        current_pool = this;
+        current_index = 0;
+
+        try {
+            fn();
+        } catch (...) {
+            current_pool = outer_pool;
+            current_index = outer_index;
+            throw;
+        }
+
+        current_pool = outer_pool;
+        current_index = outer_index;
+    }
+
+    /**
+     * @brief runs first and second, possibly in parallel, and returns when both are finished.
+     * Outside of run() or in a single thread pool both are simply called one after another.
+     *
+     * @param first is function run by the calling thread
+     * @param second is function offered to other workers
+     */
+    template <typename First, typename Second>
+    void fork_join(First&& first, Second&& second){
+        if (current_pool != this || workers.size() == 1){
+            first();
+            second();
+            return;
+        }
+
+        task t;
+        t.invoke = &invoke<std::remove_reference_t<Second>>;
+        t.fn = &second;
+        push(&t);
+
+        std::exception_ptr error;
+        try {
+            first();
+        } catch (...) {
+            error = std::current_exception();
+        }
+
+        if (take_back(&t)){
+            execute(&t);
+        }
+        else{
+            // Stolen: help with other tasks until the thief is done
+            while (!t.done.load(std::memory_order_acquire)){
+                if (!run_one()) std::this_thread::yield();
+            }
+        }
+
+        if (error) std::rethrow_exception(error);
+        if (t.error) std::rethrow_exception(t.error);
+    }
+};
@@ -0,0 +1,191 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+// SIMD scanning needs x86-64, where SSE2 is always there, and GCC or Clang for runtime AVX2 dispatch.
+// Define AVL_TREE_NO_SIMD to always use the scalar loop.
+#if !defined(AVL_TREE_NO_SIMD) && defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define WORD_SCAN_X86 1
+#else
+#define WORD_SCAN_X86 0
+#endif
+
+#pragma once
+
+// Splitting text into words separated by the whitespace that operator>> skips in the default "C" locale:
+// ' ', '\t', '\n', '\v', '\f' and '\r'. Every other byte, punctuation and bytes >= 0x80 included, is part of a word.
+
+namespace avl_detail{
+    inline bool is_space(char c){
+        return c == ' ' || (c >= '\t' && c <= '\r');
+    }
+
+    // Sets bit i of masks[b] when byte 64 * b + i of text is whitespace, for blocks * 64 bytes
+    using whitespace_masks_fn = void (*)(const char* text, std::size_t blocks, std::uint64_t* masks);
+
+    inline int count_trailing_zeros(std::uint64_t bits){
+#if defined(__GNUC__)
+        return __builtin_ctzll(bits);
+#else
+        int count = 0;
+        while ((bits & 1) == 0){
+            bits >>= 1;
+            count++;
+        }
+        return count;
+#endif
+    }
+
+#if WORD_SCAN_X86
+    inline void whitespace_masks_sse2(const char* text, std::size_t blocks, std::uint64_t* masks){
+        const __m128i space = _mm_set1_epi8(' ');
+        const __m128i below_tab = _mm_set1_epi8('\t' - 1);
+        const __m128i above_cr = _mm_set1_epi8('\r' + 1);
+
+        for (std::size_t b = 0; b < blocks; ++b, text += 64){
+            std::uint64_t mask = 0;
+            for (int part = 0; part < 4; ++part){
+                __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + 16 * part));
+                // Signed compares leave bytes >= 0x80 out of the '\t'..'\r' range
+                __m128i control = _mm_and_si128(_mm_cmpgt_epi8(bytes, below_tab), _mm_cmplt_epi8(bytes, above_cr));
+                __m128i white = _mm_or_si128(_mm_cmpeq_epi8(bytes, space), control);
+                mask |= static_cast<std::uint64_t>(static_cast<std::uint16_t>(_mm_movemask_epi8(white))) << (16 * part);
+            }
+            masks[b] = mask;
+        }
+    }
+
+    __attribute__((target("avx2")))
+    inline void whitespace_masks_avx2(const char* text, std::size_t blocks, std::uint64_t* masks){
+        const __m256i space = _mm256_set1_epi8(' ');
+        const __m256i below_tab = _mm256_set1_epi8('\t' - 1);
+        const __m256i above_cr = _mm256_set1_epi8('\r' + 1);
+
+        for (std::size_t b = 0; b < blocks; ++b, text += 64){
+            std::uint64_t mask = 0;
+            for (int part = 0; part < 2; ++part){
+                __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + 32 * part));
+                __m256i control = _mm256_and_si256(_mm256_cmpgt_epi8(bytes, below_tab), _mm256_cmpgt_epi8(above_cr, bytes));
+                __m256i white = _mm256_or_si256(_mm256_cmpeq_epi8(bytes, space), control);
+                mask |= static_cast<std::uint64_t>(static_cast<std::uint32_t>(_mm256_movemask_epi8(white))) << (32 * part);
+            }
+            masks[b] = mask;
+        }
+    }
+#endif
+
+    // Best implementation the CPU supports, null when only the scalar loop is available
+    inline whitespace_masks_fn best_whitespace_masks(){
+#if WORD_SCAN_X86
+        static const whitespace_masks_fn best = __builtin_cpu_supports("avx2") ? whitespace_masks_avx2 : whitespace_masks_sse2;
+        return best;
+#else
+        return nullptr;
+#endif
+    }
+}
+
+/**
+ * @brief calls fn with every word of text, one byte at a time
+ *
+ * @param text is text that will be split
+ * @param fn is function called with std::string_view of every word, pointing into text
+ */
+template <typename Fn>
+void for_each_word_scalar(std::string_view text, Fn fn){
+    const char *p = text.data(), *last = p + text.size();
+    while (true){
+        while (p != last && avl_detail::is_space(*p)) ++p;
+        if (p == last) break;
+
+        const char *word = p;
+        while (p != last && !avl_detail::is_space(*p)) ++p;
+        fn(std::string_view(word, p - word));
+    }
+}
+
+/**
+ * @brief calls fn with every word of text, whitespace is found 64 bytes at a time with masks_of.
+ * Word starts are the non-whitespace bytes after whitespace and word ends the whitespace bytes after a word,
+ * both are read from the masks with bit operations.
+ *
+ * @param text is text that will be split
+ * @param fn is function called with std::string_view of every word, pointing into text
+ * @param masks_of is function that classifies bytes, for_each_word_scalar() is used if it is null
+ */
+template <typename Fn>
+void for_each_word(std::string_view text, Fn fn, avl_detail::whitespace_masks_fn masks_of){
+    if (masks_of == nullptr){
+        for_each_word_scalar(text, fn);
+        return;
+    }
+
+    // Masks are computed for 4 KB at a time, then words are cut out of that part of text
+    constexpr std::size_t batch_blocks = 64;
+    std::uint64_t masks[batch_blocks];
+
+    const char *word = nullptr;             // start of the word in progress
+    std::uint64_t previous_white = 1;       // whether the byte before the block is whitespace
+
+    auto emit = [&](const char* block, std::size_t blocks){
+        for (std::size_t b = 0; b < blocks; ++b){
+            std::uint64_t white = masks[b];
+            std::uint64_t after_white = (white << 1) | previous_white;
+            previous_white = white >> 63;
+
+            std::uint64_t bounds = (~white & after_white) | (white & ~after_white);
+            while (bounds != 0){
+                const char *p = block + 64 * b + avl_detail::count_trailing_zeros(bounds);
+                if (word == nullptr) word = p;
+                else{
+                    fn(std::string_view(word, p - word));
+                    word = nullptr;
+                }
+                bounds &= bounds - 1;
+            }
+        }
+    };
+
+    const char *text_begin = text.data();
+    std::size_t full_blocks = text.size() / 64;
+    for (std::size_t done = 0; done < full_blocks; done += batch_blocks){
+        std::size_t blocks = std::min(batch_blocks, full_blocks - done);
+        masks_of(text_begin + 64 * done, blocks, masks);
+        emit(text_begin + 64 * done, blocks);
+    }
+
+    // Last partial block is classified from a copy padded with spaces, padding never starts a word
+    std::size_t rest = text.size() % 64;
+    if (rest != 0){
+        char padded[64];
+        std::memset(padded, ' ', sizeof(padded));
+        std::memcpy(padded, text_begin + 64 * full_blocks, rest);
+        masks_of(padded, 1, masks);
+        emit(text_begin + 64 * full_blocks, 1);
+    }
+
+    if (word != nullptr) fn(std::string_view(word, text_begin + text.size() - word));
+}
+
+/**
+ * @brief calls fn with every word of text using the fastest scanner the CPU supports
+ *
+ * @param text is text that will be split
+ * @param fn is function called with std::string_view of every word, pointing into text
+ */
+template <typename Fn>
+void for_each_word(std::string_view text, Fn fn){
+    for_each_word(text, fn, avl_detail::best_whitespace_masks());
+}
+
+// Name of the scanner for_each_word() uses on this CPU
+inline const char* word_scan_name(){
+#if WORD_SCAN_X86
+    return (avl_detail::best_whitespace_masks() == avl_detail::whitespace_masks_avx2) ? "avx2" : "sse2";
+#else
+    return "scalar";
+#endif
+}